@@ -6,6 +6,7 @@
 
 #include "testing.h"
 #include "../src/globals.h"
+#include "../src/sw.h"
 
 char display_title[20];
 char display_text[20];
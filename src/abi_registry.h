@@ -0,0 +1,353 @@
+////////////////////////////////////////////////////////////////////////////////
+// CONTRACT ABI REGISTRY
+////////////////////////////////////////////////////////////////////////////////
+
+// The names and types of the arguments of contract functions are stored on
+// the flash memory (NVM). They are registered by the host, one function at a
+// time, after the user approves them on the device.
+// The entries are indexed by a hash of the contract address and the function
+// name, using open addressing with linear probing. Entries are never removed
+// one by one, only the whole registry can be cleared.
+// When a call to a registered function is displayed, each argument is shown
+// on its own screen, with its name as the title.
+
+// Types of the arguments
+#define ABI_ARG_TEXT    0   // displayed as is, strings without the quotes
+#define ABI_ARG_NUMBER  1   // integer or bignum, displayed as a plain number
+#define ABI_ARG_AMOUNT  2   // integer or bignum in aer, displayed in AERGO
+
+#ifndef N_abi_registry
+const struct abi_entry N_abi_registry_real[ABI_REGISTRY_SIZE];
+#define N_abi_registry ((struct abi_entry *)PIC(N_abi_registry_real))
+#endif
+
+/*
+** FNV-1a hash of the contract address and the function name. 0 is used to
+** mark empty entries, so it is never returned.
+*/
+static uint32_t abi_key(const unsigned char *contract, const char *function, unsigned int len) {
+  uint32_t hash = 2166136261u;
+  unsigned int i;
+
+  for (i = 0; i < 33; i++) {
+    hash = (hash ^ contract[i]) * 16777619u;
+  }
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char) function[i]) * 16777619u;
+  }
+
+  return hash ? hash : 1;
+}
+
+static bool abi_entry_matches(struct abi_entry *entry, uint32_t key,
+                              const unsigned char *contract, const char *function, unsigned int len) {
+  return (entry->key == key &&
+          memcmp(entry->contract, contract, 33) == 0 &&
+          strlen(entry->function) == len &&
+          memcmp(entry->function, function, len) == 0);
+}
+
+/*
+** Returns the slot of the given function or, if not registered, the empty
+** slot where it would be stored. Returns -1 if the registry is full.
+*/
+static int abi_find_slot(uint32_t key, const unsigned char *contract, const char *function, unsigned int len) {
+  unsigned int i, slot = key % ABI_REGISTRY_SIZE;
+
+  for (i = 0; i < ABI_REGISTRY_SIZE; i++) {
+    struct abi_entry *entry = &N_abi_registry[slot];
+    if (entry->key == 0 || abi_entry_matches(entry, key, contract, function, len)) {
+      return slot;
+    }
+    slot = (slot + 1) % ABI_REGISTRY_SIZE;
+  }
+
+  return -1;
+}
+
+static struct abi_entry * abi_lookup(const unsigned char *contract, const char *function, unsigned int len) {
+  uint32_t key = abi_key(contract, function, len);
+  int slot = abi_find_slot(key, contract, function, len);
+
+  if (slot < 0 || N_abi_registry[slot].key == 0) {
+    return NULL;
+  }
+  return &N_abi_registry[slot];
+}
+
+static void abi_store(struct abi_entry *entry) {
+  int slot = abi_find_slot(entry->key, entry->contract, entry->function, strlen(entry->function));
+
+  if (slot < 0) {
+    THROW(SW_ABI_REGISTRY_FULL);
+  }
+  nvm_write((void *)&N_abi_registry[slot], entry, sizeof(struct abi_entry));
+}
+
+static void abi_clear_registry() {
+  uint32_t empty = 0;
+  int i;
+
+  for (i = 0; i < ABI_REGISTRY_SIZE; i++) {
+    if (N_abi_registry[i].key != 0) {
+      nvm_write((void *)&N_abi_registry[i].key, &empty, sizeof(empty));
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// REGISTRATION
+////////////////////////////////////////////////////////////////////////////////
+
+static bool is_valid_abi_name(unsigned char *name, unsigned int len, unsigned int max_len) {
+  unsigned int i;
+
+  if (len == 0 || len > max_len) return false;
+  for (i = 0; i < len; i++) {
+    if (name[i] <= 0x20 || name[i] >= 0x7F || name[i] == '"') return false;
+  }
+  return true;
+}
+
+static void append_str(char *out, unsigned int *pos, const char *str) {
+  unsigned int len = strlen(str);
+  memcpy(out + *pos, str, len);
+  *pos += len;
+  out[*pos] = 0;
+}
+
+/*
+** The entry is sent as:
+**   contract address (33) | function name length (1) | function name |
+**   number of arguments (1) | for each one: type (1) | name length (1) | name
+*/
+static void on_register_abi(unsigned char *buf, unsigned int len) {
+  struct abi_entry *entry = &arena.abi.entry;
+  unsigned int pos = 0, size, i;
+
+  memset(entry, 0, sizeof(struct abi_entry));
+
+  if (len < 33 + 1) THROW(SW_WRONG_LENGTH);
+  memcpy(entry->contract, buf, 33);
+  pos = 33;
+
+  size = buf[pos++];
+  if (pos + size + 1 > len) THROW(SW_WRONG_LENGTH);
+  if (!is_valid_abi_name(buf + pos, size, ABI_FUNCTION_LEN)) THROW(SW_INVALID_ABI);
+  memcpy(entry->function, buf + pos, size);
+  pos += size;
+
+  entry->num_args = buf[pos++];
+  if (entry->num_args > ABI_MAX_ARGS) THROW(SW_INVALID_ABI);
+
+  for (i = 0; i < entry->num_args; i++) {
+    if (pos + 2 > len) THROW(SW_WRONG_LENGTH);
+    entry->arg_types[i] = buf[pos++];
+    if (entry->arg_types[i] > ABI_ARG_AMOUNT) THROW(SW_INVALID_ABI);
+    size = buf[pos++];
+    if (pos + size > len) THROW(SW_WRONG_LENGTH);
+    if (!is_valid_abi_name(buf + pos, size, ABI_ARG_NAME_LEN)) THROW(SW_INVALID_ABI);
+    memcpy(entry->arg_names[i], buf + pos, size);
+    pos += size;
+  }
+
+  if (pos != len) THROW(SW_WRONG_LENGTH);
+
+  entry->key = abi_key(entry->contract, entry->function, strlen(entry->function));
+
+  /* check if there is space before asking the user */
+  if (abi_find_slot(entry->key, entry->contract, entry->function, strlen(entry->function)) < 0) {
+    THROW(SW_ABI_REGISTRY_FULL);
+  }
+
+  /* the list of arguments, like: to, amount (AERGO) */
+  pos = 0;
+  arena.abi.args_str[0] = 0;
+  for (i = 0; i < entry->num_args; i++) {
+    if (i > 0) append_str(arena.abi.args_str, &pos, ", ");
+    append_str(arena.abi.args_str, &pos, entry->arg_names[i]);
+    if (entry->arg_types[i] == ABI_ARG_NUMBER) {
+      append_str(arena.abi.args_str, &pos, " (number)");
+    } else if (entry->arg_types[i] == ABI_ARG_AMOUNT) {
+      append_str(arena.abi.args_str, &pos, " (AERGO)");
+    }
+  }
+  if (entry->num_args == 0) {
+    append_str(arena.abi.args_str, &pos, "none");
+  }
+
+  encode_account(entry->contract, 33, arena.abi.contract_address, sizeof arena.abi.contract_address);
+
+  clear_screens();
+  max_pages = 0;
+  add_screens("Contract", arena.abi.contract_address, strlen(arena.abi.contract_address), false);
+  add_screens("Function", entry->function, strlen(entry->function), false);
+  add_screens("Arguments", arena.abi.args_str, pos, false);
+
+  /* the entry on the arena waits for the approval */
+  stream_part(INS_REGISTER_ABI, true);
+
+  is_signing = false;
+  is_first_part = true;
+  is_last_part = true;
+  txn_is_complete = true;
+  display_proper_page();
+
+}
+
+/*
+** Called when the user approves the entry. It is stored only if it is still
+** the one displayed: a command that writes on the arena ends the review.
+*/
+static void on_abi_approved() {
+  stream_approve(INS_REGISTER_ABI);
+  abi_store(&arena.abi.entry);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DISPLAY
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+** Returns the length of the JSON value at the start of the text, or 0 if
+** it is incomplete.
+*/
+static unsigned int json_value_len(char *text, unsigned int len) {
+  unsigned int i;
+  int level = 0;
+  bool in_string = false;
+
+  for (i = 0; i < len; i++) {
+    char c = text[i];
+    if (in_string) {
+      if (c == '\\') {
+        i++;
+      } else if (c == '"') {
+        in_string = false;
+        if (level == 0) return i + 1;
+      }
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == '{' || c == '[') {
+      level++;
+    } else if (c == '}' || c == ']') {
+      if (level == 0) return i;
+      if (--level == 0) return i + 1;
+    } else if (c == ',' && level == 0) {
+      return i;
+    }
+  }
+
+  return 0;
+}
+
+static bool is_digits(char *text, unsigned int len) {
+  unsigned int i;
+  if (len == 0) return false;
+  for (i = 0; i < len; i++) {
+    if (text[i] < '0' || text[i] > '9') return false;
+  }
+  return true;
+}
+
+/*
+** Gets the digits of a number argument: 123, "123" or {"_bignum":"123"}
+*/
+static bool get_number_arg(char **pvalue, unsigned int *plen) {
+  char *value = *pvalue;
+  unsigned int len = *plen;
+
+  if (len > 13 && strncmp(value, "{\"_bignum\":\"", 12) == 0 && value[len-1] == '}') {
+    value += 12;
+    len -= 12 + 2;
+  } else if (len >= 2 && value[0] == '"') {
+    value += 1;
+    len -= 2;
+  }
+  if (!is_digits(value, len)) {
+    return false;
+  }
+
+  *pvalue = value;
+  *plen = len;
+  return true;
+}
+
+/*
+** Displays the arguments of a call to a registered function, each one on
+** its own screen. Returns false, without adding screens, if the function is
+** not registered, the arguments do not match the entry or an amount cannot
+** be shown in AERGO, so the call is displayed as usual.
+*/
+static bool display_call_with_abi() {
+  char *function_name, *args, *values[ABI_MAX_ARGS];
+  unsigned int name_len, args_len, sizes[ABI_MAX_ARGS];
+  struct abi_entry *entry;
+  unsigned int i, len, num_amounts = 0;
+
+  /* the whole payload must be on this part */
+  if (has_partial_payload || txn.recipient_len != 33) return false;
+  if (!parse_payload(&function_name, &name_len, &args, &args_len)) return false;
+
+  entry = abi_lookup(txn.recipient, function_name, name_len);
+  if (!entry) return false;
+
+  /* split the arguments: [<value>,<value>]} */
+  if (args == NULL) {
+    if (entry->num_args != 0) return false;
+  } else {
+    for (i = 0; i < ABI_MAX_ARGS && args_len > 0 && *args != ']'; i++) {
+      len = json_value_len(args, args_len);
+      if (len == 0 || len >= args_len) return false;
+      values[i] = args;
+      sizes[i] = len;
+      args += len;
+      args_len -= len;
+      if (*args == ',') {
+        args++;
+        args_len--;
+      }
+    }
+    if (i != entry->num_args || args_len != 2 || strncmp(args, "]}", 2) != 0) {
+      return false;
+    }
+  }
+
+  /* format the values */
+  for (i = 0; i < entry->num_args; i++) {
+    if (entry->arg_types[i] == ABI_ARG_TEXT) {
+      if (sizes[i] >= 2 && values[i][0] == '"') {
+        values[i]++;
+        sizes[i] -= 2;
+      }
+    } else if (entry->arg_types[i] == ABI_ARG_AMOUNT) {
+      /* the amounts are shown only in AERGO, never as raw aer */
+      char *out;
+      if (num_amounts >= ABI_MAX_AMOUNTS || !get_number_arg(&values[i], &sizes[i])) {
+        return false;
+      }
+      out = arena.txn.arg_amounts[num_amounts];
+      if (!adjustDecimals(values[i], sizes[i], out, sizeof(arena.txn.arg_amounts[0]) - 6, DECIMALS)) {
+        return false;
+      }
+      strcat(out, " AERGO");
+      values[i] = out;
+      sizes[i] = strlen(out);
+      num_amounts++;
+    } else {
+      get_number_arg(&values[i], &sizes[i]);
+    }
+  }
+
+  /* the values are parsed like on the generic display */
+  add_screens("Function", function_name, name_len, true);
+  for (i = 0; i < entry->num_args; i++) {
+    if (sizes[i] == 0) {
+      add_screens(entry->arg_names[i], "(empty)", 7, true);
+    } else {
+      add_screens(entry->arg_names[i], values[i], sizes[i], true);
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////////
+// ADDRESS BOOK
+////////////////////////////////////////////////////////////////////////////////
+
+// Short labels for known accounts and contracts, stored on the flash memory
+// (NVM). They are added by the host, one at a time, after the user approves
+// them on the device.
+// The entries are indexed by a hash of the address, using open addressing
+// with linear probing, like the contract ABI registry.
+// When a transaction is displayed, a recipient that is on the address book
+// is shown by its label, followed by the full address.
+
+#ifndef N_address_book
+const struct address_entry N_address_book_real[ADDRESS_BOOK_SIZE];
+#define N_address_book ((struct address_entry *)PIC(N_address_book_real))
+#endif
+
+// FNV-1a hash of the address. 0 is used to mark empty entries.
+static uint32_t address_key(const unsigned char *address) {
+  uint32_t hash = 2166136261u;
+  unsigned int i;
+
+  for (i = 0; i < 33; i++) {
+    hash = (hash ^ address[i]) * 16777619u;
+  }
+
+  return hash ? hash : 1;
+}
+
+/*
+** Returns the slot of the given address or, if not on the address book,
+** the empty slot where it would be stored. Returns -1 if it is full.
+*/
+static int address_find_slot(uint32_t key, const unsigned char *address) {
+  unsigned int i, slot = key % ADDRESS_BOOK_SIZE;
+
+  for (i = 0; i < ADDRESS_BOOK_SIZE; i++) {
+    struct address_entry *entry = &N_address_book[slot];
+    if (entry->key == 0 ||
+        (entry->key == key && memcmp(entry->address, address, 33) == 0)) {
+      return slot;
+    }
+    slot = (slot + 1) % ADDRESS_BOOK_SIZE;
+  }
+
+  return -1;
+}
+
+static struct address_entry * address_lookup(const unsigned char *address) {
+  int slot = address_find_slot(address_key(address), address);
+
+  if (slot < 0 || N_address_book[slot].key == 0) {
+    return NULL;
+  }
+  return &N_address_book[slot];
+}
+
+static void address_store(struct address_entry *entry) {
+  int slot = address_find_slot(entry->key, entry->address);
+
+  if (slot < 0) {
+    THROW(SW_ADDRESS_BOOK_FULL);
+  }
+  nvm_write((void *)&N_address_book[slot], entry, sizeof(struct address_entry));
+}
+
+static void address_book_clear() {
+  uint32_t empty = 0;
+  int i;
+
+  for (i = 0; i < ADDRESS_BOOK_SIZE; i++) {
+    if (N_address_book[i].key != 0) {
+      nvm_write((void *)&N_address_book[i].key, &empty, sizeof(empty));
+    }
+  }
+}
+
+/*
+** The entry is sent as: address (33) | label length (1) | label
+*/
+static void on_add_address(unsigned char *buf, unsigned int len) {
+  struct address_entry *entry = &arena.contact.entry;
+  unsigned int size, i;
+
+  memset(entry, 0, sizeof(struct address_entry));
+
+  if (len < 33 + 1) THROW(SW_WRONG_LENGTH);
+  size = buf[33];
+  if (33 + 1 + size != len) THROW(SW_WRONG_LENGTH);
+  if (size == 0 || size > ADDRESS_LABEL_LEN) THROW(SW_INVALID_LABEL);
+  for (i = 0; i < size; i++) {
+    unsigned char c = buf[34 + i];
+    if (c < 0x20 || c >= 0x7F) THROW(SW_INVALID_LABEL);
+  }
+
+  memcpy(entry->address, buf, 33);
+  memcpy(entry->label, buf + 34, size);
+  entry->key = address_key(entry->address);
+
+  /* check if there is space before asking the user */
+  if (address_find_slot(entry->key, entry->address) < 0) {
+    THROW(SW_ADDRESS_BOOK_FULL);
+  }
+
+  encode_account(entry->address, 33, arena.contact.address, sizeof arena.contact.address);
+
+  clear_screens();
+  max_pages = 0;
+  add_screens("Address", arena.contact.address, strlen(arena.contact.address), false);
+  add_screens("Label", entry->label, size, false);
+
+  /* the entry on the arena waits for the approval */
+  stream_part(INS_ADD_ADDRESS, true);
+
+  is_signing = false;
+  is_first_part = true;
+  is_last_part = true;
+  txn_is_complete = true;
+  display_proper_page();
+
+}
+
+/*
+** Called when the user approves the entry. It is stored only if it is still
+** the one displayed: a command that writes on the arena ends the review.
+*/
+static void on_address_approved() {
+  stream_approve(INS_ADD_ADDRESS);
+  address_store(&arena.contact.entry);
+}
+
+/*
+** Sets the label of the transaction recipient, if it is on the address book.
+*/
+static void lookup_recipient_label() {
+  struct address_entry *entry;
+  unsigned int len;
+
+  arena.txn.recipient_label[0] = 0;
+
+  if (!txn.recipient || txn.recipient_len != 33) return;
+
+  entry = address_lookup(txn.recipient);
+  if (!entry) return;
+
+  len = strlen(entry->label);
+  memcpy(arena.txn.recipient_label, entry->label, len);
+  strcpy(arena.txn.recipient_label + len, " (verified)");
+}
+
+/*
+** Adds the recipient screens: the label and then the full address, or just
+** the address if it is not on the address book.
+*/
+static void add_recipient_screens(char *title) {
+  if (arena.txn.recipient_label[0] != 0) {
+    add_screens(title, arena.txn.recipient_label, strlen(arena.txn.recipient_label), false);
+    add_screens("Address", arena.txn.recipient_address, strlen(arena.txn.recipient_address), false);
+  } else {
+    add_screens(title, arena.txn.recipient_address, strlen(arena.txn.recipient_address), false);
+  }
+}
@@ -4,7 +4,26 @@
 #define INS_GET_PUBLIC_KEY  0x02
 #define INS_DISPLAY_ACCOUNT 0x03
 #define INS_SIGN_TXN        0x04
+#define INS_SIGN_BATCH      0x05
+#define INS_GET_PUBLIC_KEYS 0x06
+#define INS_GET_EXTENDED_KEY 0x07
 #define INS_SIGN_MSG        0x08
+#define INS_PARSE_TXN       0x09
+#define INS_DECLARE_TXN     0x0A
+#define INS_REGISTER_ABI    0x0B
+#define INS_ADD_ADDRESS     0x0C
+#define INS_ADD_POLICY      0x0D
+#define INS_GET_STATS       0x0E
+#define INS_GET_TRACE       0x0F
+#define INS_GET_STACK_USAGE 0x10
+#define INS_GET_SCREEN      0x11
 #define P1_FIRST 0x01
 #define P1_LAST  0x02
+#define P1_PATH  0x04
 #define P1_HEX   0x08
+#define P1_SIGNATURES 0x10
+#define P1_PREHASHED  0x20
+#define P1_COMPRESSED 0x40
+#define P1_MIDDLE     0x10
+#define P1_CONFIRM 0x01
+#define P1_RESET   0x01
@@ -0,0 +1,108 @@
+////////////////////////////////////////////////////////////////////////////////
+// BATCH SIGNING
+////////////////////////////////////////////////////////////////////////////////
+
+// A batch is a list of simple transfers, each one sent complete in a single
+// APDU. They are hashed one by one as they arrive and only the hashes and a
+// summary are kept. The user reviews the summary once and then the signatures
+// are retrieved with separate commands.
+
+static void clear_batch() {
+  batch_count = 0;
+  batch_is_approved = false;
+}
+
+static void add_batch_recipient() {
+  int i;
+
+  for (i = 0; i < arena.txn.batch.num_recipients; i++) {
+    if (strcmp(arena.txn.batch.recipients[i], arena.txn.recipient_address) == 0) {
+      return;
+    }
+  }
+
+  strcpy(arena.txn.batch.recipients[arena.txn.batch.num_recipients++], arena.txn.recipient_address);
+}
+
+static void display_batch() {
+  int i;
+
+  /* the total amount */
+  encode_amount256(&arena.txn.batch.total, arena.txn.amount_str, sizeof arena.txn.amount_str);
+
+  /* the number of transfers */
+  i = batch_count;
+  if (i >= 10) {
+    arena.txn.batch.count_str[0] = '0' + i / 10;
+    arena.txn.batch.count_str[1] = '0' + i % 10;
+    arena.txn.batch.count_str[2] = 0;
+  } else {
+    arena.txn.batch.count_str[0] = '0' + i;
+    arena.txn.batch.count_str[1] = 0;
+  }
+
+  clear_screens();
+  max_pages = 0;
+
+  add_screens("Transfers", arena.txn.batch.count_str, strlen(arena.txn.batch.count_str), false);
+  add_screens("Total", arena.txn.amount_str, strlen(arena.txn.amount_str), false);
+  for (i = 0; i < arena.txn.batch.num_recipients; i++) {
+    add_screens("Recipient", arena.txn.batch.recipients[i], strlen(arena.txn.batch.recipients[i]), false);
+  }
+  add_screens("Chain ID", (char*)arena.txn.batch.chain_id, 32, false);
+  fields[num_fields-1].in_hex = true;
+  count_screens();
+
+  is_signing = true;
+  is_first_part = true;
+  is_last_part = true;
+  txn_is_complete = true;
+  display_proper_page();
+
+}
+
+static void on_new_batch_txn(unsigned char *buf, unsigned int len, bool is_first, bool is_last){
+  uint256_t amount;
+
+  stream_part(INS_SIGN_BATCH, is_first);
+
+  if (is_first) {
+    clear_batch();
+    clear256(&arena.txn.batch.total);
+    arena.txn.batch.num_recipients = 0;
+  } else if (batch_count == 0 || batch_is_approved) {
+    THROW(SW_INVALID_STATE);
+  }
+
+  if (batch_count >= MAX_BATCH_SIZE) {
+    THROW(SW_BATCH_FULL);
+  }
+
+  /* each transaction must be sent complete */
+  parse_transaction_part(buf, len, true, true);
+
+  if (!is_simple_transfer()) {
+    clear_batch();
+    THROW(SW_BATCH_INVALID_TXN);
+  }
+
+  /* all the transactions must be on the same chain */
+  if (batch_count == 0) {
+    memcpy(arena.txn.batch.chain_id, txn.chainId, 32);
+  } else if (memcmp(arena.txn.batch.chain_id, txn.chainId, 32) != 0) {
+    clear_batch();
+    THROW(SW_BATCH_INVALID_TXN);
+  }
+
+  memcpy(arena.txn.batch.hashes[batch_count++], txn_hash, 32);
+
+  convertUint256BE(txn.amount, txn.amount_len, &amount);
+  add256(&arena.txn.batch.total, &amount, &arena.txn.batch.total);
+
+  add_batch_recipient();
+
+  if (is_last) {
+    display_batch();
+  }
+
+}
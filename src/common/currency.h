@@ -73,13 +73,11 @@ bool adjustDecimals(char *src, uint32_t srcLength, char *target,
 
 #define DECIMALS 18
 
-void encode_amount(unsigned char *buf, unsigned int len, char *out, unsigned int outlen) {
-  uint256_t uint256;
+void encode_amount256(uint256_t *value, char *out, unsigned int outlen) {
   unsigned int i;
   char temp_buffer[100];
 
-  convertUint256BE(buf, len, &uint256);
-  tostring256(&uint256, 10, (char *) temp_buffer, sizeof temp_buffer);
+  tostring256(value, 10, (char *) temp_buffer, sizeof temp_buffer);
   i = 0;
   while (temp_buffer[i]) {
     i++;
@@ -97,3 +95,10 @@ void encode_amount(unsigned char *buf, unsigned int len, char *out, unsigned int
   out[i] = 0;  /* null terminator */
 
 }
+
+void encode_amount(unsigned char *buf, unsigned int len, char *out, unsigned int outlen) {
+  uint256_t uint256;
+
+  convertUint256BE(buf, len, &uint256);
+  encode_amount256(&uint256, out, outlen);
+}
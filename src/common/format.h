@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+** Allocation-free formatting of binary data and escaped characters for the
+** display layer. It does not depend on the formatted print functions.
+*/
+
+/*
+** Lookup table with the 2 hex digits of each byte value.
+*/
+static const char hex_bytes[] =
+  "000102030405060708090A0B0C0D0E0F"
+  "101112131415161718191A1B1C1D1E1F"
+  "202122232425262728292A2B2C2D2E2F"
+  "303132333435363738393A3B3C3D3E3F"
+  "404142434445464748494A4B4C4D4E4F"
+  "505152535455565758595A5B5C5D5E5F"
+  "606162636465666768696A6B6C6D6E6F"
+  "707172737475767778797A7B7C7D7E7F"
+  "808182838485868788898A8B8C8D8E8F"
+  "909192939495969798999A9B9C9D9E9F"
+  "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+  "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+  "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+  "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+  "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+  "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+#define HEX_HIGH(c)  hex_bytes[2 * (unsigned char)(c)]
+#define HEX_LOW(c)   hex_bytes[2 * (unsigned char)(c) + 1]
+
+/*
+** Writes the bytes as hex digits. The output must have space for 2 * len
+** characters. Returns the number of characters written.
+*/
+static inline unsigned int format_hex(char *out, const unsigned char *data, unsigned int len) {
+  const char *digits;
+  unsigned int i;
+
+  for (i = 0; i < len; i++) {
+    digits = &hex_bytes[2 * data[i]];
+    out[0] = digits[0];
+    out[1] = digits[1];
+    out += 2;
+  }
+
+  return 2 * len;
+}
+
+/*
+** Writes a non-ASCII code point as \uXXXX, using the minimum number of
+** uppercase hex digits (at least 2). The output must have space for 8
+** characters. Returns the number of characters written.
+*/
+static inline unsigned int format_unicode_escape(char *out, unsigned int c) {
+  unsigned int num_digits, i;
+
+  num_digits = 2 + (c > 0xFF) + (c > 0xFFF) + (c > 0xFFFF) + (c > 0xFFFFF);
+
+  out[0] = '\\';
+  out[1] = 'u';
+  for (i = num_digits + 1; i >= 2; i--) {
+    out[i] = hex_bytes[2 * (c & 0xF) + 1];
+    c >>= 4;
+  }
+
+  return num_digits + 2;
+}
+
+/*
+** Writes an unsigned integer in decimal. The output must have space for 10
+** characters. Returns the number of characters written.
+*/
+static inline unsigned int format_uint(char *out, uint32_t value) {
+  char digits[10];
+  unsigned int n = 0, i;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+
+  for (i = 0; i < n; i++) {
+    out[i] = digits[n - 1 - i];
+  }
+
+  return n;
+}
+
+/*
+** Writes an unsigned 64-bit integer in decimal. The output must have space
+** for 20 characters. Returns the number of characters written.
+*/
+static inline unsigned int format_uint64(char *out, uint64_t value) {
+  char digits[20];
+  unsigned int n = 0, i;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+
+  for (i = 0; i < n; i++) {
+    out[i] = digits[n - 1 - i];
+  }
+
+  return n;
+}
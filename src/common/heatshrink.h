@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+** Decoder for the heatshrink compression format (LZSS), with a window of
+** 2^8 bytes and a lookahead of 2^4 bytes (heatshrink -w 8 -l 4).
+**
+** Each compressed block is independent. The output buffer is also used as
+** the window, so no other memory is required.
+**
+** The stream is a sequence of bits, most significant first:
+**   1 <byte:8>                  literal byte
+**   0 <offset-1:8> <count-1:4>  copy count bytes from offset bytes back
+** The last bits, not enough for a complete item, are padding.
+*/
+
+#define HEATSHRINK_WINDOW_BITS     8
+#define HEATSHRINK_LOOKAHEAD_BITS  4
+
+struct bit_reader {
+  const unsigned char *data;
+  unsigned int len;
+  unsigned int pos;    // in bits
+};
+
+static bool read_bits(struct bit_reader *reader, unsigned int count, unsigned int *value) {
+  unsigned int result = 0;
+
+  if (reader->pos + count > reader->len * 8) {
+    return false;
+  }
+  while (count-- > 0) {
+    unsigned int bit = (reader->data[reader->pos / 8] >> (7 - reader->pos % 8)) & 1;
+    result = (result << 1) | bit;
+    reader->pos++;
+  }
+
+  *value = result;
+  return true;
+}
+
+/*
+** Returns the number of bytes written to the output, or -1 if the block is
+** invalid or does not fit on the output.
+*/
+static int heatshrink_decode(const unsigned char *in, unsigned int in_len,
+                             unsigned char *out, unsigned int out_max) {
+  struct bit_reader reader = { in, in_len, 0 };
+  unsigned int tag, value, offset, count, out_len = 0;
+
+  while (read_bits(&reader, 1, &tag)) {
+    if (tag) {
+      if (!read_bits(&reader, 8, &value)) break;
+      if (out_len >= out_max) return -1;
+      out[out_len++] = value;
+    } else {
+      if (!read_bits(&reader, HEATSHRINK_WINDOW_BITS, &offset)) break;
+      if (!read_bits(&reader, HEATSHRINK_LOOKAHEAD_BITS, &count)) break;
+      offset++;
+      count++;
+      if (offset > out_len || out_len + count > out_max) return -1;
+      /* the regions can overlap: copy byte by byte */
+      while (count-- > 0) {
+        out[out_len] = out[out_len - offset];
+        out_len++;
+      }
+    }
+  }
+
+  return out_len;
+}
@@ -35,11 +35,3 @@ static const unsigned char UTF8Trans1[] = {
       || (c&0xFFFFF800)==0xD800                            \
       || (c&0xFFFFFFFE)==0xFFFE ){ c = 0xFFFD; }           \
 
-/*
-** Array for converting from half-bytes (nybbles) into ASCII hex
-** digits.
-*/
-static const char hexdigits[] = {
-  '0', '1', '2', '3', '4', '5', '6', '7',
-  '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
-};
@@ -1,15 +1,19 @@
 
-int crypto_derive_private_key(cx_ecfp_private_key_t *private_key) {
+int crypto_derive_path_key(uint32_t *path, uint8_t path_len, cx_ecfp_private_key_t *private_key,
+                           uint8_t *chain_code) {
     uint8_t raw_private_key[32] = {0};
+    STATS_BEGIN();
+
+    STATS_INC(derivations);
 
     BEGIN_TRY {
         TRY {
-            // derive the seed with bip32_path
+            // derive the seed with the given path
             os_perso_derive_node_bip32(CX_CURVE_256K1,
-                                       bip32_path,
-                                       bip32_path_len,
+                                       path,
+                                       path_len,
                                        raw_private_key,
-                                       NULL);
+                                       chain_code);
             // new private_key from raw
             cx_ecfp_init_private_key(CX_CURVE_256K1,
                                      raw_private_key,
@@ -26,9 +30,17 @@ int crypto_derive_private_key(cx_ecfp_private_key_t *private_key) {
     }
     END_TRY;
 
+    STATS_END(STATS_DERIVE);
     return 0;
 }
 
+int crypto_derive_private_key(cx_ecfp_private_key_t *private_key) {
+    if (signing_path_len > 0) {
+        return crypto_derive_path_key(signing_path, signing_path_len, private_key, NULL);
+    }
+    return crypto_derive_path_key(bip32_path, bip32_path_len, private_key, NULL);
+}
+
 int crypto_init_public_key(cx_ecfp_private_key_t *private_key) {
     // generate corresponding public key
     cx_ecfp_generate_pair(CX_CURVE_256K1, &public_key, private_key, 1);
@@ -41,25 +53,45 @@ int crypto_init_public_key(cx_ecfp_private_key_t *private_key) {
     return 0;
 }
 
+bool crypto_parse_path(unsigned char *data, unsigned char len,
+                       uint32_t *path, uint8_t *path_len) {
+  unsigned char i;
+
+  /* the length must be a multiple of 4 */
+  if ((len & 0x03) != 0) {
+    return false;
+  }
+  *path_len = len / 4;
+  if (*path_len < 1 || *path_len > MAX_BIP32_PATH) {
+    return false;
+  }
+  for (i = 0; i < *path_len; i++) {
+    path[i] = U4BE(data, 0);
+    data += 4;
+  }
+
+  return true;
+}
+
 bool crypto_select_account(unsigned char *bip32Path,
                            unsigned char  bip32PathLength) {
-  unsigned char i;
 
   account_selected = false;
+  selected_key = NULL;
 
   // store the BIP32 path
 
-  /* the length must be a multiple of 4 */
-  if ((bip32PathLength & 0x03) != 0) {
-    return false;
-  }
-  bip32_path_len = bip32PathLength / 4;
-  if (bip32_path_len < 1 || bip32_path_len > MAX_BIP32_PATH) {
+  if (!crypto_parse_path(bip32Path, bip32PathLength, bip32_path, &bip32_path_len)) {
     return false;
   }
-  for (i = 0; i < bip32_path_len; i++) {
-    bip32_path[i] = U4BE(bip32Path, 0);
-    bip32Path += 4;
+
+  // use the public key from the cache, if recently selected
+
+  selected_key = key_cache_find(bip32_path, bip32_path_len);
+  if (selected_key) {
+    memcpy(public_key.W, selected_key->pubkey, 33);
+    account_selected = true;
+    return true;
   }
 
   // generate the public key for this account
@@ -68,9 +100,10 @@ bool crypto_select_account(unsigned char *bip32Path,
 
   BEGIN_TRY {
     TRY {
-      crypto_derive_private_key(&private_key);
+      crypto_derive_path_key(bip32_path, bip32_path_len, &private_key, NULL);
       io_seproxyhal_io_heartbeat();  // required?
       crypto_init_public_key(&private_key);
+      selected_key = key_cache_add(bip32_path, bip32_path_len, public_key.W);
     }
     CATCH_OTHER(e) {
       explicit_bzero(&private_key, sizeof(private_key));
@@ -85,13 +118,101 @@ bool crypto_select_account(unsigned char *bip32Path,
 
 }
 
-int crypto_sign_message(unsigned char *signature, unsigned int sig_max_len) {
+/*
+** Reads the signing path sent before the data: the number of elements
+** (1 byte) followed by the elements. Returns the number of bytes read.
+*/
+unsigned int crypto_read_signing_path(unsigned char *data, unsigned int len) {
+  unsigned int size;
+
+  if (len < 1) {
+    THROW(SW_WRONG_LENGTH);
+  }
+  size = 1 + 4 * data[0];
+  if (size > len || !crypto_parse_path(data + 1, size - 1, signing_path, &signing_path_len)) {
+    signing_path_len = 0;
+    THROW(SW_WRONG_LENGTH);
+  }
+
+  return size;
+}
+
+/*
+** The signing key is derived by the main loop once the review is shown,
+** before it waits for the user, so the approval does not wait for the
+** BIP32 derivation. It is kept only on this slot, and wiped after signing,
+** on reject, on a command that is not read-only or after some time without
+** approval.
+*/
+
+#define SIGNING_KEY_LIFETIME 600  // ticker events (100 ms each)
+
+static cx_ecfp_private_key_t signing_key;
+static bool signing_key_pending;
+static bool signing_key_ready;
+static unsigned int signing_key_ticks;
+
+void crypto_wipe_signing_key() {
+    explicit_bzero(&signing_key, sizeof(signing_key));
+    signing_key_pending = false;
+    signing_key_ready = false;
+}
+
+void crypto_prepare_signing_key() {
+    crypto_wipe_signing_key();
+    signing_key_pending = true;
+}
+
+// called by the main loop, outside of the event handlers
+void crypto_derive_signing_key() {
+
+    if (!signing_key_pending) return;
+    signing_key_pending = false;
+
+    BEGIN_TRY {
+        TRY {
+            crypto_derive_private_key(&signing_key);
+            signing_key_ready = true;
+            signing_key_ticks = SIGNING_KEY_LIFETIME;
+        }
+        CATCH_OTHER(e) {
+            // it will be derived on the approval
+            crypto_wipe_signing_key();
+        }
+        FINALLY {
+        }
+    }
+    END_TRY;
+
+}
+
+// called on each ticker event
+void crypto_on_ticker() {
+
+    if (signing_key_ready && --signing_key_ticks == 0) {
+        crypto_wipe_signing_key();
+    }
+
+}
+
+/*
+** Signs the txn_hash. When recid is not NULL it receives the recovery id
+** of the signature (the parity of R on bit 0).
+*/
+int crypto_sign_message(unsigned char *signature, unsigned int sig_max_len, unsigned char *recid) {
     cx_ecfp_private_key_t private_key = {0};
     uint32_t info = 0;
     int sig_len = 0;
 
-    // derive private key according to BIP32 path
-    crypto_derive_private_key(&private_key);
+    // use the key derived during the review, or derive it now
+    if (signing_key_ready) {
+        memcpy(&private_key, &signing_key, sizeof(private_key));
+    } else {
+        crypto_derive_private_key(&private_key);
+    }
+    crypto_wipe_signing_key();
+
+    STATS_BEGIN();
 
     BEGIN_TRY {
         TRY {
@@ -115,8 +236,175 @@ int crypto_sign_message(unsigned char *signature, unsigned int sig_max_len) {
     }
     END_TRY;
 
-    //tx_info.v = (uint8_t)(info & CX_ECCINFO_PARITY_ODD);
+    STATS_END(STATS_SIGN);
+
+    if (recid) {
+        *recid = ((info & CX_ECCINFO_PARITY_ODD) ? 1 : 0) |
+                 ((info & CX_ECCINFO_xGTn) ? 2 : 0);
+    }
     signature[0] &= 0xF0; // discard the parity information
 
     return sig_len;
 }
+
+/*
+** Signs the hashes of an approved batch, starting at the given index, with
+** the private key derived only once. Each signature is written as its length
+** (1 byte) followed by the DER signature, while there is space for one more.
+** Returns the number of bytes written.
+*/
+unsigned int crypto_sign_batch(unsigned int first, unsigned char *out, unsigned int max_len) {
+    cx_ecfp_private_key_t private_key = {0};
+    uint32_t info = 0;
+    unsigned int pos = 0, i;
+    int sig_len;
+
+    // derive private key according to BIP32 path
+    crypto_derive_private_key(&private_key);
+
+    STATS_BEGIN();
+
+    BEGIN_TRY {
+        TRY {
+            for (i = first; i < (unsigned int) batch_count; i++) {
+                if (pos + 1 + MAX_DER_SIGNATURE > max_len) break;
+                sig_len = cx_ecdsa_sign(&private_key,
+                                        CX_RND_RFC6979 | CX_LAST,
+                                        CX_SHA256,
+                                        arena.txn.batch.hashes[i],
+                                        32,
+                                        out + pos + 1,
+                                        MAX_DER_SIGNATURE,
+                                        &info);
+                out[pos + 1] &= 0xF0; // discard the parity information
+                out[pos] = sig_len;
+                pos += 1 + sig_len;
+            }
+        }
+        CATCH_OTHER(e) {
+            explicit_bzero(&private_key, sizeof(private_key));
+            THROW(e);
+        }
+        FINALLY {
+            explicit_bzero(&private_key, sizeof(private_key));
+        }
+    }
+    END_TRY;
+
+    STATS_END(STATS_SIGN);
+    return pos;
+}
+
+/*
+** Stores the base path and the number of public keys to export. The last
+** element of the path is the first index, followed by the count (2 bytes).
+** The selected account is not changed.
+*/
+bool crypto_start_key_range(unsigned char *data, unsigned char len) {
+  unsigned int count;
+  uint32_t index;
+
+  keys_to_export = 0;
+
+  if (len < 6) {
+    return false;
+  }
+  count = U2BE(data, len - 2);
+  if (count == 0) {
+    return false;
+  }
+  if (!crypto_parse_path(data, len - 2, arena.keys.path, &arena.keys.path_len)) {
+    return false;
+  }
+
+  /* the range cannot cross the hardened boundary */
+  index = arena.keys.path[arena.keys.path_len - 1];
+  if ((index & 0x7FFFFFFF) + count > 0x80000000) {
+    return false;
+  }
+
+  keys_to_export = count;
+  return true;
+}
+
+/*
+** Writes the next compressed public keys of the range, as many as fit on
+** the output. Returns the number of bytes written.
+*/
+unsigned int crypto_next_public_keys(unsigned char *out, unsigned int max_len) {
+  cx_ecfp_private_key_t private_key;
+  cx_ecfp_public_key_t key;
+  unsigned int pos = 0;
+
+  while (keys_to_export > 0 && pos + 33 <= max_len) {
+    BEGIN_TRY {
+      TRY {
+        crypto_derive_path_key(arena.keys.path, arena.keys.path_len, &private_key, NULL);
+        io_seproxyhal_io_heartbeat();
+        cx_ecfp_generate_pair(CX_CURVE_256K1, &key, &private_key, 1);
+      }
+      CATCH_OTHER(e) {
+        explicit_bzero(&private_key, sizeof(private_key));
+        keys_to_export = 0;
+        THROW(e);
+      }
+      FINALLY {
+        explicit_bzero(&private_key, sizeof(private_key));
+      }
+    }
+    END_TRY;
+
+    // convert the public key to compact format (33 bytes)
+    key.W[0] = ((key.W[64] & 1) ? 0x03 : 0x02);
+    memcpy(out + pos, key.W, 33);
+    pos += 33;
+
+    arena.keys.path[arena.keys.path_len - 1]++;
+    keys_to_export--;
+  }
+
+  return pos;
+}
+
+/*
+** The extended key is only exported at the account level: 44'/441'/account'.
+** Its non-hardened children (change / address_index) are the ones derived
+** by the host, and the chain code of another level is never needed.
+*/
+bool crypto_is_account_path(uint32_t *path, uint8_t path_len) {
+  return path_len == 3 &&
+         path[0] == (44 | 0x80000000) &&
+         path[1] == (441 | 0x80000000) &&
+         (path[2] & 0x80000000) != 0;
+}
+
+/*
+** Writes the compressed public key (33 bytes) followed by the chain code
+** (32 bytes) of the given path. Returns the number of bytes written.
+*/
+unsigned int crypto_get_extended_key(uint32_t *path, uint8_t path_len, unsigned char *out) {
+  cx_ecfp_private_key_t private_key;
+  cx_ecfp_public_key_t key;
+
+  BEGIN_TRY {
+    TRY {
+      crypto_derive_path_key(path, path_len, &private_key, out + 33);
+      io_seproxyhal_io_heartbeat();
+      cx_ecfp_generate_pair(CX_CURVE_256K1, &key, &private_key, 1);
+    }
+    CATCH_OTHER(e) {
+      explicit_bzero(&private_key, sizeof(private_key));
+      THROW(e);
+    }
+    FINALLY {
+      explicit_bzero(&private_key, sizeof(private_key));
+    }
+  }
+  END_TRY;
+
+  // convert the public key to compact format (33 bytes)
+  key.W[0] = ((key.W[64] & 1) ? 0x03 : 0x02);
+  memcpy(out, key.W, 33);
+
+  return 33 + 32;
+}
@@ -1,35 +1,88 @@
 
-#pragma GCC diagnostic ignored "-Wformat-invalid-specifier"  // snprintf
-#pragma GCC diagnostic ignored "-Wformat-extra-args"         // snprintf
-
 void reset_current_state();
 void on_anterior_delimiter();
 void on_posterior_delimiter();
+bool is_simple_transfer();
 
 ////////////////////////////////////////////////////////////////////////////////
 // START STEPS
 ////////////////////////////////////////////////////////////////////////////////
 
 // Step with icon and text
-UX_STEP_NOCB(step_confirm_address, pn, {&C_icon_eye, "Confirm Address"});
+UX_STEP_NOCB_INIT(step_confirm_address,
+                  pn,
+                  SCREEN_STRINGS("Confirm Address", ""),
+                  {&C_icon_eye, "Confirm Address"});
+
+// Step with icon and text
+UX_STEP_NOCB_INIT(step_review_transaction,
+                  pnn,
+                  SCREEN_STRINGS("Review", "Transaction"),
+                  {
+                      &C_icon_eye,
+                      "Review",
+                      "Transaction",
+                  });
+
+// Step with icon and text
+UX_STEP_NOCB_INIT(step_review_batch,
+                  pnn,
+                  SCREEN_STRINGS("Review", "Batch"),
+                  {
+                      &C_icon_eye,
+                      "Review",
+                      "Batch",
+                  });
+
+// Step with icon and text
+UX_STEP_NOCB_INIT(step_export_key,
+                  pnn,
+                  SCREEN_STRINGS("Export", "Extended Key"),
+                  {
+                      &C_icon_eye,
+                      "Export",
+                      "Extended Key",
+                  });
+
+// Step with icon and text
+UX_STEP_NOCB_INIT(step_register_abi,
+                  pnn,
+                  SCREEN_STRINGS("Register", "Contract ABI"),
+                  {
+                      &C_icon_eye,
+                      "Register",
+                      "Contract ABI",
+                  });
 
 // Step with icon and text
-UX_STEP_NOCB(step_review_transaction,
-             pnn,
-             {
-                 &C_icon_eye,
-                 "Review",
-                 "Transaction",
-             });
+UX_STEP_NOCB_INIT(step_add_address,
+                  pnn,
+                  SCREEN_STRINGS("Add to", "Address Book"),
+                  {
+                      &C_icon_eye,
+                      "Add to",
+                      "Address Book",
+                  });
 
 // Step with icon and text
-UX_STEP_NOCB(step_review_message,
-             pnn,
-             {
-                 &C_icon_eye,
-                 "Review",
-                 "Message",
-             });
+UX_STEP_NOCB_INIT(step_add_policy,
+                  pnn,
+                  SCREEN_STRINGS("Add Signing", "Policy"),
+                  {
+                      &C_icon_eye,
+                      "Add Signing",
+                      "Policy",
+                  });
+
+// Step with icon and text
+UX_STEP_NOCB_INIT(step_review_message,
+                  pnn,
+                  SCREEN_STRINGS("Review", "Message"),
+                  {
+                      &C_icon_eye,
+                      "Review",
+                      "Message",
+                  });
 
 ////////////////////////////////////////////////////////////////////////////////
 // DYNAMIC STEPS
@@ -44,9 +97,10 @@ UX_STEP_INIT(
    }
 );
 
-UX_STEP_NOCB(
+UX_STEP_NOCB_INIT(
    step_generic,
    bnnn_paging,
+   SCREEN_STRINGS(global_title, global_text),
    {
       .title = global_title,
       .text  = global_text,
@@ -67,30 +121,184 @@ UX_STEP_INIT(
 ////////////////////////////////////////////////////////////////////////////////
 
 // Step with approve button
-UX_STEP_CB(step_approve,
-           pb,
-           sign_transaction(),
-           {
-               &C_icon_validate_14,
-               "Approve",
-           });
+UX_STEP_CB_INIT(step_approve,
+                pb,
+                SCREEN_STRINGS("Approve", ""),
+                sign_transaction(),
+                {
+                    &C_icon_validate_14,
+                    "Approve",
+                });
+
+// Step with approve button
+UX_STEP_CB_INIT(step_approve_batch,
+                pb,
+                SCREEN_STRINGS("Approve All", ""),
+                approve_batch(),
+                {
+                    &C_icon_validate_14,
+                    "Approve All",
+                });
+
+// Step with approve button
+UX_STEP_CB_INIT(step_approve_export,
+                pb,
+                SCREEN_STRINGS("Approve", ""),
+                send_extended_key(),
+                {
+                    &C_icon_validate_14,
+                    "Approve",
+                });
+
+// Step with approve button
+UX_STEP_CB_INIT(step_approve_abi,
+                pb,
+                SCREEN_STRINGS("Approve", ""),
+                approve_abi(),
+                {
+                    &C_icon_validate_14,
+                    "Approve",
+                });
+
+// Step with approve button
+UX_STEP_CB_INIT(step_approve_address,
+                pb,
+                SCREEN_STRINGS("Approve", ""),
+                approve_address(),
+                {
+                    &C_icon_validate_14,
+                    "Approve",
+                });
+
+// Step with approve button
+UX_STEP_CB_INIT(step_approve_policy,
+                pb,
+                SCREEN_STRINGS("Approve", ""),
+                approve_policy(),
+                {
+                    &C_icon_validate_14,
+                    "Approve",
+                });
 
 // Step with reject button
-UX_STEP_CB(step_reject,
-           pb,
-           reject_transaction(),
-           {
-               &C_icon_crossmark,
-               "Reject",
-           });
+UX_STEP_CB_INIT(step_reject,
+                pb,
+                SCREEN_STRINGS("Reject", ""),
+                reject_transaction(),
+                {
+                    &C_icon_crossmark,
+                    "Reject",
+                });
+
+UX_STEP_CB_INIT(step_back,
+                pb,
+                SCREEN_STRINGS("Back", ""),
+                ui_menu_main(),
+                {
+                    &C_icon_back,
+                    "Back",
+                });
+
+////////////////////////////////////////////////////////////////////////////////
+// SIMPLE TRANSFER
+////////////////////////////////////////////////////////////////////////////////
+
+UX_STEP_NOCB_INIT(
+   step_transfer_amount,
+   bnnn_paging,
+   SCREEN_STRINGS("Amount", arena.txn.amount_str),
+   {
+      .title = "Amount",
+      .text  = arena.txn.amount_str,
+   }
+);
+
+UX_STEP_NOCB_INIT(
+   step_transfer_recipient,
+   bnnn_paging,
+   SCREEN_STRINGS("Recipient", arena.txn.recipient_address),
+   {
+      .title = "Recipient",
+      .text  = arena.txn.recipient_address,
+   }
+);
 
-UX_STEP_CB(step_back,
-           pb,
-           ui_menu_main(),
-           {
-               &C_icon_back,
-               "Back",
-           });
+// FLOW for a complete transfer without payload:
+// all the fields are in RAM, so the pages do not depend on the
+// dynamic display and the delimiters are not required
+UX_FLOW(ux_transfer_flow,
+        &step_review_transaction,
+        &step_transfer_amount,
+        &step_transfer_recipient,
+        &step_approve,
+        &step_reject,
+        FLOW_LOOP);
+
+UX_STEP_NOCB_INIT(
+   step_transfer_label,
+   bnnn_paging,
+   SCREEN_STRINGS("Recipient", arena.txn.recipient_label),
+   {
+      .title = "Recipient",
+      .text  = arena.txn.recipient_label,
+   }
+);
+
+UX_STEP_NOCB_INIT(
+   step_transfer_address,
+   bnnn_paging,
+   SCREEN_STRINGS("Address", arena.txn.recipient_address),
+   {
+      .title = "Address",
+      .text  = arena.txn.recipient_address,
+   }
+);
+
+// FLOW for a complete transfer to a recipient on the address book
+UX_FLOW(ux_transfer_labeled_flow,
+        &step_review_transaction,
+        &step_transfer_amount,
+        &step_transfer_label,
+        &step_transfer_address,
+        &step_approve,
+        &step_reject,
+        FLOW_LOOP);
+
+////////////////////////////////////////////////////////////////////////////////
+// SIGNING POLICY
+////////////////////////////////////////////////////////////////////////////////
+
+UX_STEP_NOCB_INIT(
+   step_policy,
+   bnnn_paging,
+   SCREEN_STRINGS("Sign by Policy", arena.txn.policy_text),
+   {
+      .title = "Sign by Policy",
+      .text  = arena.txn.policy_text,
+   }
+);
+
+// FLOW for a transaction that matches a stored policy
+UX_FLOW(ux_policy_flow,
+        &step_policy,
+        &step_approve,
+        &step_reject,
+        FLOW_LOOP);
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Step with the progress of a declared transaction, while receiving it
+UX_STEP_NOCB_INIT(step_receiving,
+                  bn,
+                  SCREEN_STRINGS("Receiving", global_text),
+                  {"Receiving", global_text});
+
+UX_FLOW(ux_receiving_flow,
+        &step_receiving);
+
+void display_progress() {
+  ux_flow_init(0, ux_receiving_flow, NULL);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -104,19 +312,58 @@ const ux_flow_step_t *ux_generic_flow[MAX_NUM_STEPS + 1];
 void start_display() {
   uint8_t index = 0;
 
+  if (cmd_type == INS_SIGN_TXN && matched_policy) {
+    ux_flow_init(0, ux_policy_flow, NULL);
+    return;
+  }
+
+  if (cmd_type == INS_SIGN_TXN && is_simple_transfer()) {
+    if (arena.txn.recipient_label[0] != 0) {
+      ux_flow_init(0, ux_transfer_labeled_flow, NULL);
+    } else {
+      ux_flow_init(0, ux_transfer_flow, NULL);
+    }
+    return;
+  }
+
   if (cmd_type == INS_SIGN_TXN) {
     ux_generic_flow[index++] = &step_review_transaction;
+  } else if (cmd_type == INS_SIGN_BATCH) {
+    ux_generic_flow[index++] = &step_review_batch;
   } else if (cmd_type == INS_SIGN_MSG) {
     ux_generic_flow[index++] = &step_review_message;
   } else if (cmd_type == INS_DISPLAY_ACCOUNT) {
     ux_generic_flow[index++] = &step_confirm_address;
+  } else if (cmd_type == INS_GET_EXTENDED_KEY) {
+    ux_generic_flow[index++] = &step_export_key;
+  } else if (cmd_type == INS_REGISTER_ABI) {
+    ux_generic_flow[index++] = &step_register_abi;
+  } else if (cmd_type == INS_ADD_ADDRESS) {
+    ux_generic_flow[index++] = &step_add_address;
+  } else if (cmd_type == INS_ADD_POLICY) {
+    ux_generic_flow[index++] = &step_add_policy;
   }
 
   ux_generic_flow[index++] = &step_anterior_delimiter;
   ux_generic_flow[index++] = &step_generic;
   ux_generic_flow[index++] = &step_posterior_delimiter;
 
-  if (is_signing) {
+  if (cmd_type == INS_SIGN_BATCH) {
+    ux_generic_flow[index++] = &step_approve_batch;
+    ux_generic_flow[index++] = &step_reject;
+  } else if (cmd_type == INS_GET_EXTENDED_KEY) {
+    ux_generic_flow[index++] = &step_approve_export;
+    ux_generic_flow[index++] = &step_reject;
+  } else if (cmd_type == INS_REGISTER_ABI) {
+    ux_generic_flow[index++] = &step_approve_abi;
+    ux_generic_flow[index++] = &step_reject;
+  } else if (cmd_type == INS_ADD_ADDRESS) {
+    ux_generic_flow[index++] = &step_approve_address;
+    ux_generic_flow[index++] = &step_reject;
+  } else if (cmd_type == INS_ADD_POLICY) {
+    ux_generic_flow[index++] = &step_approve_policy;
+    ux_generic_flow[index++] = &step_reject;
+  } else if (is_signing) {
     ux_generic_flow[index++] = &step_approve;
     ux_generic_flow[index++] = &step_reject;
   } else {
@@ -202,6 +449,7 @@ void on_next_page_cb(bool has_dynamic_data) {
 ////////////////////////////////////////////////////////////////////////////////
 
 void on_anterior_delimiter() {
+  STATS_BEGIN();
 
   if (current_state == STATIC_SCREEN) {  // clicking NEXT [>]
     get_next_data(PAGE_FIRST, on_first_page_cb);
@@ -209,9 +457,11 @@ void on_anterior_delimiter() {
     get_next_data(PAGE_PREV, on_prev_page_cb);
   }
 
+  STATS_END(STATS_RENDER);
 }
 
 void on_posterior_delimiter() {
+  STATS_BEGIN();
 
   if (current_state == STATIC_SCREEN) {  // clicking PREV [<]
     get_next_data(PAGE_LAST, on_last_page_cb);
@@ -219,4 +469,5 @@ void on_posterior_delimiter() {
     get_next_data(PAGE_NEXT, on_next_page_cb);
   }
 
+  STATS_END(STATS_RENDER);
 }
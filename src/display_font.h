@@ -0,0 +1,165 @@
+// Page capacity of the bnnn_paging layout, measured with the device font.
+//
+// The text lines use the Open Sans Regular 11px font, which is proportional:
+// a page holds many more narrow glyphs (digits, lowercase, punctuation) than
+// wide ones. The pages are packed to the real pixel width of the lines.
+// On the device the glyph widths are measured at boot with the font of the
+// SDK, the same one used to render the pages.
+
+#include "common/format.h"
+
+#if defined(TARGET_NANOX) || defined(TARGET_NANOS2)
+#define LINES_PER_PAGE  3
+#elif defined(TARGET_NANOS)
+#define LINES_PER_PAGE  1
+#endif
+
+#ifdef LINES_PER_PAGE
+
+#define PAGING_LINE_WIDTH  114  // PIXEL_PER_LINE of the SDK paging layout
+#define LINE_WIDTH  (PAGING_LINE_WIDTH - 4)  // with a small margin
+
+#define MAX_CHARS_PER_PAGE  63  // limited by the size of global_text
+
+#define FIRST_GLYPH  0x20
+#define LAST_GLYPH   0x7E
+
+#ifdef HAVE_BAGL
+
+/*
+** Advance width in pixels of the printable ASCII characters (0x20 - 0x7E).
+** The display layer escapes all other characters.
+*/
+static unsigned char glyph_widths[LAST_GLYPH - FIRST_GLYPH + 1];
+
+static void display_font_init() {
+  unsigned char c;
+
+  for (c = FIRST_GLYPH; c <= LAST_GLYPH; c++) {
+    glyph_widths[c - FIRST_GLYPH] = bagl_compute_line_width(BAGL_FONT_OPEN_SANS_REGULAR_11px,
+                                                            0, &c, 1, BAGL_ENCODING_LATIN1);
+  }
+}
+
+#else
+
+/*
+** The same widths, as measured on the device, for the host tests.
+*/
+static const unsigned char glyph_widths[] = {
+  3, 3, 4, 7, 6, 10, 8, 2, 3, 3, 6, 6, 3, 4, 3, 4,   //  !"#$%&'()*+,-./
+  6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 3, 3, 6, 6, 6, 5,    // 0123456789:;<=>?
+  10, 7, 7, 7, 8, 6, 6, 8, 8, 3, 3, 7, 6, 10, 8, 9,  // @ABCDEFGHIJKLMNO
+  7, 9, 7, 6, 6, 8, 7, 10, 7, 6, 6, 4, 4, 4, 6, 5,   // PQRSTUVWXYZ[\]^_
+  6, 6, 7, 5, 7, 6, 4, 6, 7, 3, 3, 6, 3, 10, 7, 7,   // `abcdefghijklmno
+  7, 7, 4, 5, 4, 7, 6, 9, 6, 6, 5, 4, 6, 4, 6,       // pqrstuvwxyz{|}~
+};
+
+#define display_font_init()
+
+#endif
+
+static unsigned int glyph_width(unsigned char c) {
+  if (c < FIRST_GLYPH || c > LAST_GLYPH) {
+    return 10;  // the widest glyph
+  }
+  return glyph_widths[c - FIRST_GLYPH];
+}
+
+#else // fixed-width characters
+
+#define LINES_PER_PAGE  1
+#define LINE_WIDTH  13
+#define MAX_CHARS_PER_PAGE  13
+
+static unsigned int glyph_width(unsigned char c) {
+  (void) c;
+  return 1;
+}
+
+#define display_font_init()
+
+#endif
+
+/*
+** The measure of a page while its characters are added. The SDK paging
+** breaks the lines at the last space or dash, when there is one on the
+** line, so the last word moves to the next line.
+*/
+struct page_fit {
+  unsigned int size;        // characters that fit on the page
+  unsigned int num_chars;   // displayed characters
+  unsigned int line;
+  unsigned int line_width;
+  unsigned int word_width;  // width of the text after the last word break
+  bool has_break;           // the current line has a word break
+  bool is_full;
+};
+
+static void page_fit_reset(struct page_fit *fit) {
+  memset(fit, 0, sizeof(struct page_fit));
+  fit->line = 1;
+}
+
+/*
+** Adds a character to the page. When in_hex is set, it is a byte that is
+** displayed as two hex digits. Returns false when it does not fit.
+*/
+static bool page_fit_add(struct page_fit *fit, unsigned char c, bool in_hex) {
+  unsigned int width;
+  bool is_break = false;
+
+  if (fit->is_full) {
+    return false;
+  }
+  if (in_hex) {
+    width = glyph_width(HEX_HIGH(c)) + glyph_width(HEX_LOW(c));
+    fit->num_chars += 2;
+  } else {
+    width = glyph_width(c);
+    fit->num_chars++;
+    is_break = (c == ' ' || c == '-');
+  }
+  if (fit->num_chars > MAX_CHARS_PER_PAGE) {
+    fit->is_full = true;
+    return false;
+  }
+  if (fit->line_width + width > LINE_WIDTH) {
+    // the character goes to the next line
+    if (++fit->line > LINES_PER_PAGE) {
+      fit->is_full = true;
+      return false;
+    }
+    // with the last word of the line, if the line is broken at a word
+    fit->line_width = fit->has_break ? fit->word_width : 0;
+    fit->has_break = false;
+  }
+  fit->line_width += width;
+  fit->word_width += width;
+  if (is_break && fit->line_width > width) {
+    // not at the start of the line
+    fit->word_width = 0;
+    fit->has_break = true;
+  }
+  fit->size++;
+  return true;
+}
+
+/*
+** Returns how many characters from the text fit on a single page.
+** When in_hex is set, the text is binary and each byte is displayed as
+** two hex digits.
+*/
+static unsigned int fit_page(const unsigned char *text, unsigned int len, bool in_hex) {
+  struct page_fit fit;
+  unsigned int i;
+
+  page_fit_reset(&fit);
+  for (i = 0; i < len; i++) {
+    if (!page_fit_add(&fit, text[i], in_hex)) {
+      break;
+    }
+  }
+
+  return fit.size;
+}
@@ -1,9 +1,5 @@
 
-#if defined(TARGET_NANOX) || defined(TARGET_NANOS2)
-#define MAX_CHARS_PER_LINE 45
-#else // TARGET_NANOS
-#define MAX_CHARS_PER_LINE 13  // some strings do not appear entirely on the screen if bigger than this
-#endif
+#include "display_font.h"
 
 #define PAGE_FIRST 1
 #define PAGE_NEXT  2
@@ -11,20 +7,37 @@
 #define PAGE_LAST  4
 
 
+// The fields to be displayed are stored as lazy descriptors: the source text
+// and how to render it. The screens are virtual: a field that is not parsed
+// is split in pieces that fit a page on demand, one screen per piece,
+// while a parsed field uses a single screen with as many pages as required.
+
 struct items {
   char *title;
   char *text;
   unsigned int size;
+  bool parse_text;
   bool in_hex;
   bool is_call;
   bool is_multicall;
   bool trim_payload;
 };
 
-static struct items screens[10];
-static int num_screens;
+// The maximum number of fields: amount + labeled contract + address +
+// function + registered arguments, or the batch summary: count + total +
+// chain id + recipients
+#if MAX_BATCH_SIZE + 3 > ABI_MAX_ARGS + 4
+#define MAX_FIELDS (MAX_BATCH_SIZE + 3)
+#else
+#define MAX_FIELDS (ABI_MAX_ARGS + 4)
+#endif
+
+static struct items fields[MAX_FIELDS];
+static int num_fields;
+static int num_screens;  // virtual screens
 
 static int current_screen;
+static struct items *current_field;
 
 static int current_page;
 static int page_to_display;
@@ -33,8 +46,9 @@ static int max_pages;
 void (*display_page_callback)(bool);
 
 
-static char parsed_text[MAX_CHARS_PER_LINE + 20];     // remaining part
+static char parsed_text[MAX_CHARS_PER_PAGE + 20];     // remaining part
 static unsigned int  parsed_size;
+static struct page_fit parsed_fit;  // measure of the parsed text, as it grows
 
 static unsigned char*input_text;
 static unsigned int  input_size;
@@ -55,6 +69,7 @@ static void reset_screen();
 
 static bool on_last_screen();
 static bool on_last_page();
+static bool page_is_full();
 
 static void reset_text_parser();
 
@@ -64,52 +79,103 @@ static void reset_text_parser();
 
 
 static void clear_screens() {
+  num_fields = 0;
   num_screens = 0;
-  memset(screens, 0, sizeof(screens));
+  current_field = NULL;
   reset_screen();
   //reset_page();
   current_page = 0;
 }
 
-static void add_screens(char *title, char *text, unsigned int len, bool parse_text) {
+static unsigned int get_field_screens(struct items *field) {
+  unsigned int count = 0, pos = 0;
+
+  if (field->parse_text) {
+    return 1;
+  }
+  while (pos < field->size) {
+    pos += fit_page((unsigned char*)field->text + pos, field->size - pos, field->in_hex);
+    count++;
+  }
+  return count;
+}
+
+// update the number of screens when the render mode of a field changes
+static void count_screens() {
   int i;
 
-  if (parse_text) {
+  num_screens = 0;
+  for (i = 0; i < num_fields; i++) {
+    num_screens += get_field_screens(&fields[i]);
+  }
+}
 
-    i = num_screens++;
-    screens[i].title = title;
-    screens[i].text = text;
-    screens[i].size = len;
+static void add_screens(char *title, char *text, unsigned int len, bool parse_text) {
+  struct items *field;
 
-  } else {
+  // a text that is not parsed is displayed only if not empty
+  if (!parse_text && len == 0) {
+    return;
+  }
 
-    char *ptr = text;
-    while (len > 0) {
-      i = num_screens++;
-      screens[i].title = title;
-      screens[i].text = ptr;
-      screens[i].size = len > MAX_CHARS_PER_LINE ? MAX_CHARS_PER_LINE : len;
-      ptr += screens[i].size;
-      len -= screens[i].size;
-    }
+  if (num_fields >= MAX_FIELDS) {
+    THROW(SW_INVALID_STATE);
+  }
+
+  field = &fields[num_fields++];
+  field->title = title;
+  field->text = text;
+  field->size = len;
+  field->parse_text = parse_text;
+  field->in_hex = false;
+  field->is_call = false;
+  field->is_multicall = false;
+  field->trim_payload = false;
+
+  num_screens += get_field_screens(field);
 
+}
+
+// find the field of the given virtual screen (base 1) and its text offset
+static struct items * get_screen_field(int n, unsigned int *poffset) {
+  int i;
+
+  for (i = 0; i < num_fields; i++) {
+    struct items *field = &fields[i];
+    int count = get_field_screens(field);
+    if (n <= count) {
+      unsigned int offset = 0;
+      while (--n > 0) {
+        offset += fit_page((unsigned char*)field->text + offset, field->size - offset, field->in_hex);
+      }
+      *poffset = offset;
+      return field;
+    }
+    n -= count;
   }
 
+  *poffset = 0;
+  return &fields[num_fields-1];
 }
 
 static bool prepare_screen(int n) {
+  unsigned int offset;
 
   // using base 1
   current_screen = n;
   current_page = n - 1;  // increased on parse_next_page()
 
+  current_field = get_screen_field(n, &offset);
+
   // title
-  strlcpy(global_title, screens[current_screen-1].title, sizeof(global_title));
+  strlcpy(global_title, current_field->title, sizeof(global_title));
 
   // raw text (input)
-  input_text = (unsigned char*)
-               screens[current_screen-1].text;
-  input_size = screens[current_screen-1].size;
+  input_text = (unsigned char*) current_field->text + offset;
+  input_size = current_field->size - offset;
+  if (!current_field->parse_text) {
+    input_size = fit_page(input_text, input_size, current_field->in_hex);
+  }
   input_pos  = 0;
 
   // parsed text (output)
@@ -131,6 +197,7 @@ static bool display_screen(int n) {
 static void display_page() {
 
   if (display_page_callback) {
+    STATS_INC(pages);
     display_page_callback(true);
     reset_display_state();
   }
@@ -191,6 +258,7 @@ static void display_proper_page() {
     // parse the text up to the page to be displayed
     while(true){
       if (current_page == page_to_display) {
+        STATS_INC(pages);
         display_page_callback(true);
         reset_display_state();
         return;
@@ -198,6 +266,7 @@ static void display_proper_page() {
 
       if (on_last_page()) {
         if (page_to_display == -1) {
+          STATS_INC(pages);
           display_page_callback(true);
         } else {
           display_page_callback(false);
@@ -219,9 +288,8 @@ static void display_proper_page() {
 // called when a new txn part arrives
 static void display_new_input() {
 
-  input_text = (unsigned char*)
-               screens[current_screen-1].text;
-  input_size = screens[current_screen-1].size;
+  input_text = (unsigned char*) current_field->text;
+  input_size = current_field->size;
   input_pos  = 0;
 
   display_proper_page();
@@ -252,6 +320,8 @@ static void get_next_data(int move_to, void(*callback)(bool)) {
     break;
   }
 
+  TRACE_PAGE(move_to, page_to_display);
+
   if (move_to == PAGE_PREV && page_to_display < 1) {
     display_page_callback(false);
     reset_screen();
@@ -312,6 +382,23 @@ static bool on_last_page() {
           parsed_size == 0);
 }
 
+// is there enough parsed text to fill the page?
+// only the characters added since the last call are measured
+static bool page_is_full() {
+  if (parsed_size >= MAX_CHARS_PER_PAGE) {
+    return true;
+  }
+  if (parsed_size < parsed_fit.size) {
+    page_fit_reset(&parsed_fit);
+  }
+  while (parsed_fit.size < parsed_size) {
+    if (!page_fit_add(&parsed_fit, parsed_text[parsed_fit.size], false)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // parse text from input and output it to a new page  (update current screen)
 // update pointer to unparsed text - or move memory, removing old/parsed input text
 static bool parse_next_page() {
@@ -326,8 +413,8 @@ static bool parse_next_page() {
   }
 
   // if the parsed text is shorter than the max size to display
-  if (parsed_size < MAX_CHARS_PER_LINE) {
-    if (screens[current_screen-1].is_multicall) {
+  if (!page_is_full()) {
+    if (current_field->is_multicall) {
       // parse text from the input
       bool has_complete_page = parse_multicall_page();
       bool parsed_all_input = (input_pos >= input_size);
@@ -340,7 +427,7 @@ static bool parse_next_page() {
       // parse text from the input
       bool parsed_all_input = parse_page_text();
       // should we request the next txn part?
-      if (on_last_screen() && parsed_size < MAX_CHARS_PER_LINE && parsed_all_input && !txn_is_complete) {
+      if (on_last_screen() && !page_is_full() && parsed_all_input && !txn_is_complete) {
         request_next_part();
         return false;
       }
@@ -351,11 +438,8 @@ static bool parse_next_page() {
     return true;
   }
 
-  // copy output to the display buffer (limited to MAX_CHARS_PER_LINE)
-  len = parsed_size;
-  if (len > MAX_CHARS_PER_LINE) {
-    len = MAX_CHARS_PER_LINE;
-  }
+  // copy output to the display buffer (limited to what fits on a page)
+  len = fit_page((unsigned char*)parsed_text, parsed_size, false);
   memcpy(global_text, parsed_text, len);
   global_text[len] = '\0';
 
@@ -366,6 +450,7 @@ static bool parse_next_page() {
   } else {
     parsed_size = 0;
   }
+  page_fit_reset(&parsed_fit);
 
   // update the page number
   current_page++;
@@ -382,3 +467,35 @@ static bool parse_next_page() {
 
   return true;
 }
+
+#ifdef HAVE_GET_SCREEN
+/*
+** Writes what is on the screen, for automated tests on debug builds:
+**   current page (2) | number of screens (2) |
+**   title length (1) | title | text length (1) | text
+** The title and the text are the ones of the current step of the flow, set
+** by its init. On the dynamic step they are the page being displayed, and
+** the page is 0 before the first one. They are empty on the menus.
+** Returns the number of bytes written.
+*/
+static unsigned int get_screen(unsigned char *out) {
+  unsigned int pos = 0, len;
+
+  out[pos++] = current_page >> 8;
+  out[pos++] = current_page;
+  out[pos++] = num_screens >> 8;
+  out[pos++] = num_screens;
+
+  len = strlen(screen_title);
+  out[pos++] = len;
+  memcpy(out + pos, screen_title, len);
+  pos += len;
+
+  len = strlen(screen_text);
+  out[pos++] = len;
+  memcpy(out + pos, screen_text, len);
+  pos += len;
+
+  return pos;
+}
+#endif
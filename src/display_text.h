@@ -1,4 +1,5 @@
 #include "common/utf8.h"
+#include "common/format.h"
 
 static char args_separator[] = ",\"Args\":[";
 static int  args_pos;
@@ -33,6 +34,7 @@ static void reset_text_parser() {
   obj_level = 0;
   in_hex = false;
   parsed_size = 0;
+  page_fit_reset(&parsed_fit);
 
 }
 
@@ -51,20 +53,32 @@ static bool parse_page_text() {  // in_hex as argument?
   zIn  = &input_text[input_pos];
   zEnd = &input_text[input_size];
 
-  while (zIn < zEnd && parsed_size < MAX_CHARS_PER_LINE) {
+  /* binary data: expand enough bytes to fill the page at once */
+  if (current_field->in_hex) {
+    unsigned int count = 0;
+    if (parsed_size <= MAX_CHARS_PER_PAGE) {
+      count = (MAX_CHARS_PER_PAGE - parsed_size) / 2 + 1;
+    }
+    if (count > (unsigned int)(zEnd - zIn)) {
+      count = zEnd - zIn;
+    }
+    parsed_size += format_hex(&parsed_text[parsed_size], zIn, count);
+    zIn += count;
+    input_pos = zIn - input_text;
+    in_hex = true;
+    return (zIn >= zEnd);  // parsed_all_input
+  }
+
+  while (zIn < zEnd && !page_is_full()) {
     unsigned int c = 0;
     bool is_utf8 = false;
 
-    if (screens[current_screen-1].in_hex) {
-      c = *(zIn++);
+    if (last_utf8_char != 0) {
+      c = last_utf8_char;
+      last_utf8_char = 0;
+      READ_REMAINING_UTF8(zIn, zEnd, c);
     } else {
-      if (last_utf8_char != 0) {
-        c = last_utf8_char;
-        last_utf8_char = 0;
-        READ_REMAINING_UTF8(zIn, zEnd, c);
-      } else {
-        READ_UTF8(zIn, zEnd, c);
-      }
+      READ_UTF8(zIn, zEnd, c);
     }
 
     input_pos = zIn - input_text;
@@ -75,7 +89,7 @@ static bool parse_page_text() {  // in_hex as argument?
       return true;
     }
 
-    if (screens[current_screen-1].is_call) {
+    if (current_field->is_call) {
       bool showing_function = (strcmp(global_title,"Function") == 0);
       if (display_char && showing_function && c == '"') {
         display_char = false;
@@ -94,12 +108,12 @@ static bool parse_page_text() {  // in_hex as argument?
       }
     }
 
-    if (screens[current_screen-1].trim_payload) {
+    if (current_field->trim_payload) {
       unsigned int payload_pos, payload_part_offset, payload_len;
       unsigned char *payload;
       get_payload_info(&payload, &payload_len, &payload_part_offset);
       if (payload_part_offset == 0) {
-        if (screens[current_screen-1].is_call) {
+        if (current_field->is_call) {
           payload_pos = 9 + input_pos - 1;
         } else {
           payload_pos = input_text + input_pos - payload - 1;
@@ -115,18 +129,14 @@ static bool parse_page_text() {  // in_hex as argument?
       }
     }
 
-    bool use_hex_delimiters = true;
-    if (screens[current_screen-1].in_hex) {
-      in_hex = true;
-      use_hex_delimiters = false;
-    } else if (c < 0x20) {
+    if (c < 0x20) {
       if (c != '\n' && c != '\r' && c != '\t') {
         in_hex = true;  // otherwise keep the same format as the last char
       }
     } else {
       in_hex = false;
     }
-    if (use_hex_delimiters && !in_hex) {
+    if (!in_hex) {
       if (already_in_hex) {
         already_in_hex = false;
         parsed_text[parsed_size++] = '>';
@@ -134,17 +144,14 @@ static bool parse_page_text() {  // in_hex as argument?
     }
 
     if (in_hex) {
-      if (use_hex_delimiters && !already_in_hex) {
+      if (!already_in_hex) {
         already_in_hex = true;
         parsed_text[parsed_size++] = '<';
       }
-      parsed_text[parsed_size++] = hexdigits[(c >> 4) & 0xf];
-      parsed_text[parsed_size++] = hexdigits[c & 0xf];
+      parsed_text[parsed_size++] = HEX_HIGH(c);
+      parsed_text[parsed_size++] = HEX_LOW(c);
     } else if (c > 0x7F) { /* non-ascii chars */
-      parsed_text[parsed_size++] = '\\';
-      parsed_text[parsed_size++] = 'u';
-      snprintf(&parsed_text[parsed_size], sizeof(parsed_text) - parsed_size, "%X", c);
-      parsed_size += strlen(&parsed_text[parsed_size]);
+      parsed_size += format_unicode_escape(&parsed_text[parsed_size], c);
     } else if (c == '\n' || c == '\r') {
       //parsed_text[parsed_size++] = ' ';
       parsed_text[parsed_size++] = '|';
@@ -165,7 +172,7 @@ static bool parse_multicall_page() {
   zIn  = &input_text[input_pos];
   zEnd = &input_text[input_size];
 
-  while (zIn < zEnd && parsed_size < MAX_CHARS_PER_LINE) {
+  while (zIn < zEnd && !page_is_full()) {
     unsigned int c;
     bool is_utf8 = false;
     bool copy_it;
@@ -183,7 +190,7 @@ static bool parse_multicall_page() {
     /* do we have a partial UTF8 char at the end? */
     if (zIn == zEnd && is_utf8 && has_partial_payload) {
       last_utf8_char = c;
-      return (parsed_size >= MAX_CHARS_PER_LINE);
+      return page_is_full();
     }
 
     copy_it = false;
@@ -265,10 +272,7 @@ static bool parse_multicall_page() {
 
     if (copy_it) {
       if (c > 0x7F) { /* non-ascii chars */
-        parsed_text[parsed_size++] = '\\';
-        parsed_text[parsed_size++] = 'u';
-        snprintf(&parsed_text[parsed_size], sizeof(parsed_text) - parsed_size, "%X", c);
-        parsed_size += strlen(&parsed_text[parsed_size]);
+        parsed_size += format_unicode_escape(&parsed_text[parsed_size], c);
       } else if (c == '\n' || c == '\r') {
         //parsed_text[parsed_size++] = ' ';
         parsed_text[parsed_size++] = '|';
@@ -283,5 +287,5 @@ static bool parse_multicall_page() {
     last_char = c;
   }
 
-  return (parsed_size >= MAX_CHARS_PER_LINE);
+  return page_is_full();
 }
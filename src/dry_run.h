@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////
+// DRY RUN
+////////////////////////////////////////////////////////////////////////////////
+
+// The transaction parts are parsed and hashed exactly like on the signing
+// command, but nothing is displayed. The result is the transaction hash,
+// the payload hash and the parsed fields, so the host can check that the
+// device reads the transaction the same way it does.
+
+// Tags of the parsed fields
+#define DRY_TYPE       0x01
+#define DRY_NONCE      0x02
+#define DRY_RECIPIENT  0x03
+#define DRY_AMOUNT     0x04
+#define DRY_GAS_LIMIT  0x05
+#define DRY_GAS_PRICE  0x06
+#define DRY_CHAIN_ID   0x07
+
+/*
+** The fields point to the received part, so they are copied before the
+** next part arrives. The gas price is copied by the parser.
+*/
+static void on_dry_run_part(unsigned char *buf, unsigned int len, bool is_first, bool is_last){
+
+  stream_part(INS_PARSE_TXN, is_first);
+
+  gas_price_copy = arena.txn.dry.gas_price;
+  parse_transaction_part(buf, len, is_first, is_last);
+  gas_price_copy = NULL;
+
+  /* the deploys have no recipient */
+  if (is_first && txn.recipient_len > 0) {
+    memcpy(arena.txn.dry.recipient, txn.recipient, txn.recipient_len);
+  }
+  if (is_first && txn.amount_len > 0) {
+    memcpy(arena.txn.dry.amount, txn.amount, txn.amount_len);
+  }
+  if (txn_is_complete) {
+    memcpy(arena.txn.dry.chain_id, txn.chainId, 32);
+    /* calculate the payload hash */
+    sha256_finish(arena.txn.hash2, arena.txn.payload_hash);
+  }
+
+}
+
+static unsigned int add_tlv(unsigned char *out, unsigned char tag, void *value, unsigned int len) {
+  out[0] = tag;
+  out[1] = len;
+  memcpy(out + 2, value, len);
+  return 2 + len;
+}
+
+static unsigned int add_tlv_uint64(unsigned char *out, unsigned char tag, uint64_t value) {
+  unsigned char buf[8];
+  int i;
+  for (i = 7; i >= 0; i--) {
+    buf[i] = value & 0xFF;
+    value >>= 8;
+  }
+  return add_tlv(out, tag, buf, 8);
+}
+
+/*
+** Writes the txn hash, the payload hash and the parsed fields as TLV.
+** Returns the number of bytes written (up to 197).
+*/
+static unsigned int get_dry_run_result(unsigned char *out) {
+  unsigned char type = txn_type;
+  unsigned int pos = 0;
+
+  if (!txn_is_complete) {
+    THROW(SW_TXN_INCOMPLETE);
+  }
+
+  memcpy(out + pos, txn_hash, 32);
+  pos += 32;
+  memcpy(out + pos, arena.txn.payload_hash, 32);
+  pos += 32;
+
+  pos += add_tlv(out + pos, DRY_TYPE, &type, 1);
+  pos += add_tlv_uint64(out + pos, DRY_NONCE, txn.nonce);
+  if (txn.recipient) {
+    pos += add_tlv(out + pos, DRY_RECIPIENT, arena.txn.dry.recipient, txn.recipient_len);
+  }
+  pos += add_tlv(out + pos, DRY_AMOUNT, arena.txn.dry.amount, txn.amount_len);
+  pos += add_tlv_uint64(out + pos, DRY_GAS_LIMIT, txn.gasLimit);
+  pos += add_tlv(out + pos, DRY_GAS_PRICE, arena.txn.dry.gas_price, txn.gas_price_len);
+  pos += add_tlv(out + pos, DRY_CHAIN_ID, arena.txn.dry.chain_id, 32);
+
+  return pos;
+}
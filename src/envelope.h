@@ -0,0 +1,152 @@
+////////////////////////////////////////////////////////////////////////////////
+// TRANSACTION ENVELOPE
+////////////////////////////////////////////////////////////////////////////////
+
+// The host can declare a transaction before sending its parts: the total
+// length, the payload length, the type and the chain ID. The envelope itself
+// is checked when it arrives, the type and the payload length are checked on
+// the first part, before the payload is streamed, and the length and the
+// chain ID are checked when the transaction is complete.
+// The declared length is also used to show the progress of long transactions.
+
+#define ENVELOPE_SIZE  (4 + 4 + 1 + 32)
+
+static uint32_t read_uint32_be(unsigned char *buf) {
+  return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+         ((uint32_t)buf[2] << 8)  |  (uint32_t)buf[3];
+}
+
+static void clear_envelope() {
+  txn_declared = false;
+}
+
+static void on_txn_envelope(unsigned char *buf, unsigned int len) {
+  unsigned char empty[32] = {0};
+
+  clear_envelope();
+
+  if (len != ENVELOPE_SIZE) {
+    THROW(SW_WRONG_LENGTH);
+  }
+
+  arena.txn.envelope.total_len = read_uint32_be(buf);
+  arena.txn.envelope.payload_len = read_uint32_be(buf + 4);
+  arena.txn.envelope.type = buf[8];
+  memcpy(arena.txn.envelope.chain_id, buf + 9, 32);
+
+  if (arena.txn.envelope.type > TXN_MULTICALL ||
+      arena.txn.envelope.total_len < 60 ||
+      arena.txn.envelope.payload_len >= arena.txn.envelope.total_len ||
+      memcmp(arena.txn.envelope.chain_id, empty, 32) == 0) {
+    THROW(SW_INVALID_ENVELOPE);
+  }
+
+  txn_declared = true;
+}
+
+static void envelope_mismatch() {
+  clear_envelope();
+  txn_is_complete = false;  /* so it cannot be signed */
+  THROW(SW_ENVELOPE_MISMATCH);
+}
+
+/*
+** Called after each transaction part is parsed, with the part length.
+*/
+static void check_envelope_part(unsigned int len, bool is_first) {
+  uint32_t payload_len;
+
+  if (!txn_declared) return;
+
+  if (is_first) {
+    payload_len = payload_is_prehashed ? 32 : txn.payload_len;
+    if (txn_type != arena.txn.envelope.type ||
+        payload_len != arena.txn.envelope.payload_len) {
+      envelope_mismatch();
+    }
+    arena.txn.envelope.received = 0;
+    arena.txn.envelope.part_num = 0;
+    /* the host sends the parts with the size of the first one */
+    arena.txn.envelope.num_parts = (arena.txn.envelope.total_len + len - 1) / len;
+  }
+
+  arena.txn.envelope.received += len;
+  arena.txn.envelope.part_num++;
+
+  if (arena.txn.envelope.received > arena.txn.envelope.total_len) {
+    envelope_mismatch();
+  }
+  if (arena.txn.envelope.part_num > arena.txn.envelope.num_parts) {
+    arena.txn.envelope.num_parts = arena.txn.envelope.part_num;
+  }
+
+  if (txn_is_complete) {
+    if (arena.txn.envelope.received != arena.txn.envelope.total_len ||
+        memcmp(txn.chainId, arena.txn.envelope.chain_id, 32) != 0) {
+      envelope_mismatch();
+    }
+  }
+}
+
+// writes "i/N" and returns its length
+static unsigned int format_part_progress(char *out) {
+  unsigned int n;
+
+  n = format_uint(out, arena.txn.envelope.part_num);
+  out[n++] = '/';
+  n += format_uint(out + n, arena.txn.envelope.num_parts);
+  out[n] = 0;
+  return n;
+}
+
+/*
+** Adds the part number to the title of the field that is being streamed,
+** like "Payload 2/5". Used only on declared transactions with many parts.
+*/
+static void show_part_progress() {
+  struct items *field;
+  char progress[24];
+  unsigned int n, len;
+
+  if (!txn_declared || arena.txn.envelope.num_parts <= 1 || num_fields == 0) {
+    return;
+  }
+  /* the contract code is not displayed */
+  if (txn_type == TXN_DEPLOY || txn_type == TXN_REDEPLOY) {
+    return;
+  }
+
+  field = &fields[num_fields-1];
+  if (field->title != arena.txn.envelope.title) {
+    arena.txn.envelope.base_title = field->title;
+    field->title = arena.txn.envelope.title;
+  }
+
+  n = format_part_progress(progress);
+
+  len = strlen(arena.txn.envelope.base_title);
+  if (len > sizeof(arena.txn.envelope.title) - n - 2) {
+    len = sizeof(arena.txn.envelope.title) - n - 2;
+  }
+  memcpy(arena.txn.envelope.title, arena.txn.envelope.base_title, len);
+  arena.txn.envelope.title[len++] = ' ';
+  memcpy(arena.txn.envelope.title + len, progress, n + 1);
+
+  if (current_field == field) {
+    strlcpy(global_title, field->title, sizeof(global_title));
+  }
+}
+
+/*
+** Shows "Part i/N" while the parts of a transaction that is displayed only
+** when complete (contract deployment) are received.
+*/
+static void show_receiving_progress() {
+
+  if (!txn_declared) return;
+
+  memcpy(global_text, "Part ", 5);
+  format_part_progress(global_text + 5);
+  display_progress();
+
+}
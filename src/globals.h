@@ -1,9 +1,24 @@
 
+#include "common/uint256.h"
+#include "stats.h"
+#include "trace.h"
+#include "stack.h"
+
 char global_title[20];
 char global_text[64];
 
+#ifdef HAVE_GET_SCREEN
+// strings of the step on the screen, set by each step of the flows
+const char *screen_title = "";
+const char *screen_text = "";
+#define SCREEN_STRINGS(title, text)  (screen_title = (title), screen_text = (text))
+#else
+#define SCREEN_STRINGS(title, text)  ((void)0)
+#endif
+
 
 int  cmd_type;
+int  stream_ins;            // command that owns the parts and the review, 0 = none
 bool is_signing;
 bool is_first_part;
 bool is_last_part;
@@ -11,8 +26,186 @@ bool txn_is_complete;
 bool has_partial_payload;
 
 
-static cx_sha256_t hash;
-static cx_sha256_t hash2;
 unsigned char txn_hash[32];
-unsigned char payload_hash[32];
+
+
+// The maximum number of transactions on a batch. Their hashes and
+// recipients are kept on the arena until the signatures are retrieved
+#ifdef TARGET_NANOS
+#define MAX_BATCH_SIZE 4
+#else
+#define MAX_BATCH_SIZE 16
+#endif
+
+int  batch_count;
+bool batch_is_approved;
+
+
+#define MAX_BIP32_PATH 10
+
+
+// The maximum size of a decompressed transaction part
+#ifdef TARGET_NANOS
+#define INFLATED_PART_SIZE 512
+#else
+#define INFLATED_PART_SIZE 1024
+#endif
+
+unsigned int keys_to_export;
+
+// the next transaction was declared with an envelope
+bool txn_declared;
+
+
+// Contract ABI registry: argument names and types of contract functions
+#ifdef TARGET_NANOS
+#define ABI_REGISTRY_SIZE 16
+#else
+#define ABI_REGISTRY_SIZE 64
+#endif
+
+#define ABI_MAX_ARGS      5
+#define ABI_MAX_AMOUNTS   2
+#define ABI_FUNCTION_LEN  16
+#define ABI_ARG_NAME_LEN  12
+
+// Address book: labels of known accounts and contracts
+#ifdef TARGET_NANOS
+#define ADDRESS_BOOK_SIZE 32
+#else
+#define ADDRESS_BOOK_SIZE 128
+#endif
+
+#define ADDRESS_LABEL_LEN 16
+
+struct address_entry {
+  uint32_t key;                       // hash of the address, 0 = empty
+  unsigned char address[33];
+  char label[ADDRESS_LABEL_LEN+1];
+};
+
+// Signing policies: templates of recurring transactions that are signed
+// with a single confirmation
+#ifdef TARGET_NANOS
+#define POLICY_TABLE_SIZE 8
+#else
+#define POLICY_TABLE_SIZE 16
+#endif
+
+#define POLICY_RECIPIENT_LEN 33
+
+struct policy_entry {
+  uint32_t key;                       // hash of recipient + function, 0 = empty
+  unsigned char recipient[POLICY_RECIPIENT_LEN];  // address or name
+  uint8_t recipient_len;
+  char function[ABI_FUNCTION_LEN+1];
+  unsigned char chain_id[32];
+  unsigned char max_amount[16];       // big-endian, in aer
+  uint64_t next_nonce;                // the lowest accepted nonce
+  uint32_t nonce_window;              // accepted nonces after next_nonce
+};
+
+// the policy that matches the transaction being signed, if any
+struct policy_entry *matched_policy;
+
+struct abi_entry {
+  uint32_t key;                       // hash of contract + function, 0 = empty
+  unsigned char contract[33];
+  char function[ABI_FUNCTION_LEN+1];
+  uint8_t num_args;
+  uint8_t arg_types[ABI_MAX_ARGS];
+  char arg_names[ABI_MAX_ARGS][ABI_ARG_NAME_LEN+1];
+};
+
+
+// Per-command RAM arena. The buffers of each command mode are never live at
+// the same time as the ones from another mode, so they share the same memory.
+// The display buffers are used by all the modes and are kept apart.
+
+union {
+  // INS_SIGN_TXN
+  struct {
+    cx_sha256_t hash;                 // transaction hash
+    cx_sha256_t hash2;                // payload hash
+    unsigned char payload_hash[32];
+    char recipient_address[52+1];     // encoded account address
+    char recipient_label[ADDRESS_LABEL_LEN+12];  // from the address book
+    char amount_str[48];
+    char last_part[128];              // last fields, when split between parts
+    char policy_text[ABI_FUNCTION_LEN+2+48];  // function and amount, on a policy match
+    char arg_amounts[ABI_MAX_AMOUNTS][32];  // call arguments shown in AERGO
+    // declared envelope, checked against the received parts
+    struct {
+      uint32_t total_len;
+      uint32_t payload_len;
+      unsigned char type;
+      unsigned char chain_id[32];
+      uint32_t received;              // bytes received so far
+      unsigned int part_num;
+      unsigned int num_parts;
+      char *base_title;               // title of the streamed field
+      char title[20];                 // the same with the part number
+    } envelope;
+    // buffers used by only one of the modes that parse transactions
+    union {
+      // INS_SIGN_BATCH
+      struct {
+        unsigned char hashes[MAX_BATCH_SIZE][32];
+        unsigned char chain_id[32];
+        uint256_t total;
+        char count_str[4];
+        char recipients[MAX_BATCH_SIZE][52+1];  // distinct encoded addresses
+        int  num_recipients;
+      } batch;
+      // INS_PARSE_TXN - copies of the fields, the parts are not kept
+      struct {
+        unsigned char recipient[33];
+        unsigned char amount[15];
+        unsigned char gas_price[22];
+        unsigned char chain_id[32];
+      } dry;
+      // INS_SIGN_TXN with compressed parts
+      unsigned char inflated[INFLATED_PART_SIZE];   // decompressed part
+    };
+  } txn;
+  // INS_SIGN_MSG
+  struct {
+    cx_sha256_t hash;                 // message hash
+    bool as_hex;                      // the parts are shown in hex
+  } msg;
+  // INS_DISPLAY_ACCOUNT
+  struct {
+    char address[52+1];               // encoded account address
+  } account;
+  // INS_ADD_ADDRESS
+  struct {
+    struct address_entry entry;       // waiting for the user approval
+    char address[52+1];
+  } contact;
+  // INS_ADD_POLICY
+  struct {
+    struct policy_entry entry;        // waiting for the user approval
+    char recipient[52+1];
+    char max_amount[48];
+    char chain_id[64+1];
+    char nonces[48];
+  } policy;
+  // INS_REGISTER_ABI
+  struct {
+    struct abi_entry entry;           // waiting for the user approval
+    char contract_address[52+1];
+    char args_str[ABI_MAX_ARGS * (ABI_ARG_NAME_LEN + 10)];
+  } abi;
+  // INS_GET_EXTENDED_KEY
+  struct {
+    uint32_t path[MAX_BIP32_PATH];
+    uint8_t  path_len;
+    char     path_str[MAX_BIP32_PATH * 12];
+  } xkey;
+  // INS_GET_PUBLIC_KEYS
+  struct {
+    uint32_t path[MAX_BIP32_PATH];    // the last element is the next index
+    uint8_t  path_len;
+  } keys;
+} arena;
 
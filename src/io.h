@@ -25,6 +25,8 @@ unsigned char io_event(unsigned char channel) {
 
   case SEPROXYHAL_TAG_TICKER_EVENT:
     UX_TICKER_EVENT(G_io_seproxyhal_spi_buffer, {});
+    crypto_on_ticker();
+    TRACE_TICK();
     break;
 
   case SEPROXYHAL_TAG_STATUS_EVENT:
@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////
+// PUBLIC KEY CACHE
+////////////////////////////////////////////////////////////////////////////////
+
+// The public keys of the most recently selected accounts are kept in RAM,
+// so selecting one of them again does not require a new derivation. The
+// encoded address is stored on the first time it is displayed.
+// The least recently used entry is replaced when the cache is full.
+
+#ifdef TARGET_NANOS
+#define KEY_CACHE_SIZE 3
+#else
+#define KEY_CACHE_SIZE 8
+#endif
+
+struct key_cache_entry {
+  uint32_t path[MAX_BIP32_PATH];
+  uint8_t  path_len;
+  unsigned char pubkey[33];       // compressed public key
+  char address[52+1];             // encoded account address, if not empty
+  uint32_t last_used;             // 0 = empty entry
+};
+
+static struct key_cache_entry key_cache[KEY_CACHE_SIZE];
+static uint32_t key_cache_clock;
+
+// the entry of the selected account
+static struct key_cache_entry *selected_key;
+
+static inline void key_cache_clear() {
+  explicit_bzero(key_cache, sizeof(key_cache));
+  key_cache_clock = 0;
+  selected_key = NULL;
+}
+
+static inline struct key_cache_entry * key_cache_find(uint32_t *path, uint8_t path_len) {
+  int i;
+
+  for (i = 0; i < KEY_CACHE_SIZE; i++) {
+    struct key_cache_entry *entry = &key_cache[i];
+    if (entry->last_used != 0 && entry->path_len == path_len &&
+        memcmp(entry->path, path, path_len * sizeof(uint32_t)) == 0) {
+      entry->last_used = ++key_cache_clock;
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static inline struct key_cache_entry * key_cache_add(uint32_t *path, uint8_t path_len, unsigned char *pubkey) {
+  struct key_cache_entry *entry = &key_cache[0];
+  int i;
+
+  /* use an empty entry or the least recently used one */
+  for (i = 1; i < KEY_CACHE_SIZE && entry->last_used != 0; i++) {
+    if (key_cache[i].last_used < entry->last_used) {
+      entry = &key_cache[i];
+    }
+  }
+
+  memcpy(entry->path, path, path_len * sizeof(uint32_t));
+  entry->path_len = path_len;
+  memcpy(entry->pubkey, pubkey, 33);
+  entry->address[0] = 0;
+  entry->last_used = ++key_cache_clock;
+
+  return entry;
+}
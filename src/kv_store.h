@@ -0,0 +1,370 @@
+////////////////////////////////////////////////////////////////////////////////
+// KEY-VALUE STORE
+////////////////////////////////////////////////////////////////////////////////
+
+// A small log-structured key-value store over a reserved region of the flash
+// memory (NVM). The region is split in pages that are used as a ring: the
+// records are only appended to the head page and, when it is full, the next
+// page is opened. Updating or deleting a key appends a new record, so the
+// same flash page is not written again and again, and all the pages are
+// erased the same number of times.
+// One page is always kept free. When it is the only one left, the live
+// records of the oldest page (tail) are copied to the head and the tail page
+// is released.
+// Each record has a CRC, so a record that was not completely written (power
+// loss) ends the page. An index of the keys is kept in RAM, built from the
+// pages on the app start.
+//
+// API:
+//   kv_init()                       builds the index, call on the app start
+//   kv_get(key, value, max_len)     returns the value length, or -1
+//   kv_put(key, value, len)         adds or replaces a value
+//   kv_delete(key)                  removes a key
+
+// A page of the store is a page of the flash memory, so opening a page only
+// erases that page. The host tests use a simulated flash with other sizes.
+#ifndef KV_PAGE_SIZE
+#if defined(NVM_PAGE_SIZE_B)
+#define KV_PAGE_SIZE   NVM_PAGE_SIZE_B
+#elif defined(TARGET_NANOS)
+#define KV_PAGE_SIZE   64
+#else
+#define KV_PAGE_SIZE   512
+#endif
+#endif
+
+#ifdef TARGET_NANOS
+#define KV_REGION_SIZE 1024
+#define KV_MAX_KEYS    16
+#else
+#define KV_REGION_SIZE 4096
+#define KV_MAX_KEYS    32
+#endif
+
+#ifndef KV_NUM_PAGES
+#define KV_NUM_PAGES   (KV_REGION_SIZE / KV_PAGE_SIZE)
+#endif
+
+#define KV_MAX_VALUE   48             // a record fits on a page of 64 bytes
+
+#define KV_PAGE_MAGIC    0x3153564B   // "KVS1"
+#define KV_RECORD_MAGIC  0xA5
+#define KV_TOMBSTONE     0x01         // the key was deleted
+
+#define KV_PAGE_HEADER    8
+#define KV_RECORD_HEADER  8
+#define KV_RECORD_SIZE(len)  ((KV_RECORD_HEADER + (len) + 3) & ~3u)
+
+struct kv_page_header {
+  uint32_t magic;
+  uint32_t seq;                       // the higher, the newer
+};
+
+struct kv_record_header {
+  uint8_t  magic;
+  uint8_t  flags;
+  uint16_t key;
+  uint16_t len;                       // value length
+  uint16_t crc;                       // of the header fields and the value
+};
+
+struct kv_index_entry {
+  uint16_t key;
+  uint16_t len;
+  uint8_t  page;
+  uint16_t offset;
+};
+
+#ifndef N_kv_region
+const unsigned char N_kv_region_real[KV_NUM_PAGES * KV_PAGE_SIZE] __attribute__((aligned(KV_PAGE_SIZE)));
+#define N_kv_region ((unsigned char *)PIC(N_kv_region_real))
+#endif
+
+// the flash backend. the host tests replace it with a simulated flash
+#ifndef kv_flash_write
+#define kv_flash_write(dst, src, len) nvm_write((void *)(dst), (void *)(src), len)
+#endif
+#ifndef kv_flash_erase
+static void kv_flash_erase(unsigned int page) {
+  unsigned char zeros[KV_PAGE_SIZE] = {0};
+  nvm_write((void *)(N_kv_region + page * KV_PAGE_SIZE), zeros, KV_PAGE_SIZE);
+}
+#endif
+
+static struct kv_index_entry kv_index[KV_MAX_KEYS];
+static unsigned int kv_num_keys;
+
+static unsigned int kv_head;          // page being written
+static unsigned int kv_head_offset;   // next free byte on it
+static unsigned int kv_tail;          // oldest page
+static unsigned int kv_used_pages;
+static uint32_t kv_seq;               // sequence number of the head page
+
+static unsigned char * kv_page(unsigned int page) {
+  return N_kv_region + page * KV_PAGE_SIZE;
+}
+
+// CRC-16/CCITT
+static uint16_t kv_crc16(uint16_t crc, const unsigned char *data, unsigned int len) {
+  unsigned int i, j;
+
+  for (i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (j = 0; j < 8; j++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t kv_record_crc(struct kv_record_header *hdr, const unsigned char *value) {
+  uint16_t crc = kv_crc16(0xFFFF, (unsigned char *)hdr, offsetof(struct kv_record_header, crc));
+  return kv_crc16(crc, value, hdr->len);
+}
+
+static bool kv_page_is_valid(unsigned int page, struct kv_page_header *hdr) {
+  memcpy(hdr, kv_page(page), sizeof(struct kv_page_header));
+  return hdr->magic == KV_PAGE_MAGIC;
+}
+
+/*
+** Reads the header of the record at the given offset. Returns false at the
+** end of the page data or if the record is corrupted.
+*/
+static bool kv_read_record(unsigned int page, unsigned int offset, struct kv_record_header *hdr) {
+  unsigned char *ptr = kv_page(page) + offset;
+
+  if (offset + KV_RECORD_HEADER > KV_PAGE_SIZE) return false;
+  memcpy(hdr, ptr, sizeof(struct kv_record_header));
+  if (hdr->magic != KV_RECORD_MAGIC || hdr->len > KV_MAX_VALUE) return false;
+  if (offset + KV_RECORD_SIZE(hdr->len) > KV_PAGE_SIZE) return false;
+  return hdr->crc == kv_record_crc(hdr, ptr + KV_RECORD_HEADER);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// INDEX
+////////////////////////////////////////////////////////////////////////////////
+
+static int kv_find(uint16_t key) {
+  unsigned int i;
+
+  for (i = 0; i < kv_num_keys; i++) {
+    if (kv_index[i].key == key) return i;
+  }
+  return -1;
+}
+
+static void kv_index_set(uint16_t key, unsigned int len, unsigned int page, unsigned int offset) {
+  int i = kv_find(key);
+
+  if (i < 0) {
+    if (kv_num_keys == KV_MAX_KEYS) return;
+    i = kv_num_keys++;
+  }
+  kv_index[i].key = key;
+  kv_index[i].len = len;
+  kv_index[i].page = page;
+  kv_index[i].offset = offset;
+}
+
+static void kv_index_remove(uint16_t key) {
+  int i = kv_find(key);
+
+  if (i < 0) return;
+  kv_index[i] = kv_index[--kv_num_keys];
+}
+
+// adds the records of the page to the index. returns the end of its data
+static unsigned int kv_scan_page(unsigned int page) {
+  struct kv_record_header hdr;
+  unsigned int offset = KV_PAGE_HEADER;
+
+  while (kv_read_record(page, offset, &hdr)) {
+    if (hdr.flags & KV_TOMBSTONE) {
+      kv_index_remove(hdr.key);
+    } else {
+      kv_index_set(hdr.key, hdr.len, page, offset);
+    }
+    offset += KV_RECORD_SIZE(hdr.len);
+  }
+
+  return offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PAGES
+////////////////////////////////////////////////////////////////////////////////
+
+static void kv_open_page(unsigned int page, uint32_t seq) {
+  struct kv_page_header hdr;
+
+  hdr.magic = KV_PAGE_MAGIC;
+  hdr.seq = seq;
+  kv_flash_erase(page);
+  kv_flash_write(kv_page(page), &hdr, sizeof(hdr));
+}
+
+static void kv_next_page() {
+
+  if (kv_used_pages == KV_NUM_PAGES) {
+    THROW(SW_STORAGE_FULL);
+  }
+
+  kv_head = (kv_head + 1) % KV_NUM_PAGES;
+  kv_open_page(kv_head, ++kv_seq);
+  kv_head_offset = KV_PAGE_HEADER;
+  kv_used_pages++;
+
+}
+
+static void kv_write_record(uint16_t key, uint8_t flags, const unsigned char *value, unsigned int len) {
+  unsigned char buf[KV_RECORD_SIZE(KV_MAX_VALUE)];
+  struct kv_record_header hdr;
+  unsigned int size = KV_RECORD_SIZE(len);
+
+  if (kv_head_offset + size > KV_PAGE_SIZE) {
+    kv_next_page();
+  }
+
+  hdr.magic = KV_RECORD_MAGIC;
+  hdr.flags = flags;
+  hdr.key = key;
+  hdr.len = len;
+  hdr.crc = kv_record_crc(&hdr, value);
+
+  memset(buf, 0, size);
+  memcpy(buf, &hdr, sizeof(hdr));
+  memcpy(buf + KV_RECORD_HEADER, value, len);
+  kv_flash_write(kv_page(kv_head) + kv_head_offset, buf, size);
+
+  if (flags & KV_TOMBSTONE) {
+    kv_index_remove(key);
+  } else {
+    kv_index_set(key, len, kv_head, kv_head_offset);
+  }
+  kv_head_offset += size;
+
+}
+
+/*
+** Copies the live records of the oldest page to the head and releases it.
+** The deleted keys are not copied: there is no older page where they exist.
+*/
+static void kv_compact_tail() {
+  unsigned char value[KV_MAX_VALUE];
+  struct kv_record_header hdr;
+  unsigned int page = kv_tail, offset = KV_PAGE_HEADER;
+  uint32_t invalid = 0;
+  int i;
+
+  while (kv_read_record(page, offset, &hdr)) {
+    i = kv_find(hdr.key);
+    if (i >= 0 && kv_index[i].page == page && kv_index[i].offset == offset) {
+      memcpy(value, kv_page(page) + offset + KV_RECORD_HEADER, hdr.len);
+      kv_write_record(hdr.key, 0, value, hdr.len);
+    }
+    offset += KV_RECORD_SIZE(hdr.len);
+  }
+
+  kv_flash_write(kv_page(page), &invalid, sizeof(invalid));
+  kv_tail = (kv_tail + 1) % KV_NUM_PAGES;
+  kv_used_pages--;
+}
+
+// makes space for a record on the head page
+static void kv_reserve(unsigned int size) {
+  unsigned int compactions = 0;
+
+  while (kv_head_offset + size > KV_PAGE_SIZE) {
+    if (KV_NUM_PAGES - kv_used_pages > 1) {
+      kv_next_page();
+    } else if (++compactions > KV_NUM_PAGES) {
+      THROW(SW_STORAGE_FULL);  // all the records are live
+    } else {
+      kv_compact_tail();
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// API
+////////////////////////////////////////////////////////////////////////////////
+
+static void kv_init() {
+  struct kv_page_header hdr;
+  uint32_t min_seq = 0xFFFFFFFF;
+  unsigned int page, i;
+
+  kv_num_keys = 0;
+  kv_used_pages = 0;
+  kv_seq = 0;
+
+  for (page = 0; page < KV_NUM_PAGES; page++) {
+    if (!kv_page_is_valid(page, &hdr)) continue;
+    kv_used_pages++;
+    if (hdr.seq < min_seq) {
+      min_seq = hdr.seq;
+      kv_tail = page;
+    }
+    if (hdr.seq >= kv_seq) {
+      kv_seq = hdr.seq;
+      kv_head = page;
+    }
+  }
+
+  /* empty region */
+  if (kv_used_pages == 0) {
+    kv_head = kv_tail = 0;
+    kv_seq = 1;
+    kv_open_page(0, kv_seq);
+    kv_head_offset = KV_PAGE_HEADER;
+    kv_used_pages = 1;
+    return;
+  }
+
+  /* from the oldest to the newest page. if a compaction was interrupted,
+     there is no free page and it is done again on the next write */
+  for (i = 0; i < KV_NUM_PAGES; i++) {
+    page = (kv_tail + i) % KV_NUM_PAGES;
+    if (kv_page_is_valid(page, &hdr)) {
+      unsigned int end = kv_scan_page(page);
+      if (page == kv_head) kv_head_offset = end;
+    }
+  }
+}
+
+static int kv_get(uint16_t key, void *value, unsigned int max_len) {
+  int i = kv_find(key);
+  unsigned int len;
+
+  if (i < 0) return -1;
+
+  len = kv_index[i].len;
+  if (len > max_len) len = max_len;
+  memcpy(value, kv_page(kv_index[i].page) + kv_index[i].offset + KV_RECORD_HEADER, len);
+
+  return kv_index[i].len;
+}
+
+static void kv_put(uint16_t key, const void *value, unsigned int len) {
+
+  if (len > KV_MAX_VALUE) {
+    THROW(SW_WRONG_LENGTH);
+  }
+  if (kv_find(key) < 0 && kv_num_keys == KV_MAX_KEYS) {
+    THROW(SW_STORAGE_FULL);
+  }
+
+  kv_reserve(KV_RECORD_SIZE(len));
+  kv_write_record(key, 0, (const unsigned char *)value, len);
+
+}
+
+static inline void kv_delete(uint16_t key) {
+
+  if (kv_find(key) < 0) return;
+
+  kv_reserve(KV_RECORD_SIZE(0));
+  kv_write_record(key, KV_TOMBSTONE, (const unsigned char *)"", 0);
+
+}
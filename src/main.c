@@ -27,8 +27,6 @@ bolos_ux_params_t G_ux_params;
 
 // selected account - BIP32 path & public key
 
-#define MAX_BIP32_PATH 10
-
 static bool account_selected;
 
 uint32_t bip32_path[MAX_BIP32_PATH];
@@ -36,6 +34,15 @@ uint8_t bip32_path_len;
 
 cx_ecfp_public_key_t public_key;
 
+// signing path sent with the command, used instead of the selected account
+
+uint32_t signing_path[MAX_BIP32_PATH];
+uint8_t signing_path_len;
+static bool review_uses_path;   // the review was started with a signing path
+
+// maximum size of a DER encoded signature
+#define MAX_DER_SIGNATURE 72
+
 
 // functions declarations
 
@@ -43,21 +50,42 @@ static void request_first_part();
 static void request_next_part();
 
 static void on_new_transaction_part(unsigned char *text, unsigned int len, bool is_first, bool is_last);
-static void on_new_message(unsigned char *text, unsigned int len, bool as_hex);
+static void on_new_message(unsigned char *text, unsigned int len, bool as_hex, bool is_first, bool is_last);
 static void on_display_account(unsigned char *pubkey, int pklen);
+static void on_export_extended_key();
+static void on_new_batch_txn(unsigned char *buf, unsigned int len, bool is_first, bool is_last);
+static void on_abi_approved();
+static void abi_clear_registry();
+static void on_address_approved();
+static void address_book_clear();
+static void on_policy_approved();
+static void policy_mark_used();
+static void policy_clear_all();
 
 
+void crypto_on_ticker();
+void crypto_derive_signing_key();
+void crypto_wipe_signing_key();
+
 void ui_menu_main();
+void ui_menu_settings(const ux_flow_step_t *const start_step);
 void ui_menu_about();
+void app_exit();
 void start_display();
+void display_progress();
 
 
 #include "io.h"
 
 #include "common/sha256.h"
+#include "common/heatshrink.h"
+
+#include "key_cache.h"
 
 #include "crypto.h"
 
+#include "stream.h"
+
 ////////////////////////////////////////////////////////////////////////////////
 // ACTIONS
 ////////////////////////////////////////////////////////////////////////////////
@@ -65,15 +93,38 @@ void start_display();
 static void sign_transaction() {
   unsigned int tx = 0;
 
+  /* only the hash of the command being reviewed is signed */
+  if (stream_ins != INS_SIGN_TXN && stream_ins != INS_SIGN_MSG) {
+    THROW(SW_INVALID_STATE);
+  }
   if (!txn_is_complete) {
     THROW(SW_TXN_INCOMPLETE);
   }
+  /* do not sign with the selected account instead */
+  if (review_uses_path && signing_path_len == 0) {
+    THROW(SW_INVALID_STATE);
+  }
+  stream_ins = 0;
+
+  /* the envelope was used */
+  txn_declared = false;
+
+  /* the next transactions of the policy must use a higher nonce */
+  if (matched_policy) {
+    policy_mark_used();
+  }
 
   /* copy the transaction hash */
   memcpy(G_io_apdu_buffer, txn_hash, 32);
 
   /* create a signature for the transaction hash */
-  tx = crypto_sign_message(G_io_apdu_buffer+32, sizeof(G_io_apdu_buffer)-32);
+  if (signing_path_len > 0) {
+    /* with the recovery id, so the public key can be recovered */
+    tx = crypto_sign_message(G_io_apdu_buffer+33, sizeof(G_io_apdu_buffer)-33, G_io_apdu_buffer+32);
+    if (tx > 0) tx++;
+  } else {
+    tx = crypto_sign_message(G_io_apdu_buffer+32, sizeof(G_io_apdu_buffer)-32, NULL);
+  }
 
   if (tx > 0) {
     tx += 32; /* the txn hash */
@@ -85,6 +136,7 @@ static void sign_transaction() {
     tx = 2;
   }
 
+  TRACE_APDU_OUT(G_io_apdu_buffer, tx);
   // Send back the response and return without waiting for new APDU
   io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, tx);
 
@@ -93,21 +145,132 @@ static void sign_transaction() {
 }
 
 static void reject_transaction() {
+  crypto_wipe_signing_key();
+  stream_ins = 0;
+  txn_declared = false;
+  matched_policy = NULL;
   G_io_apdu_buffer[0] = 0x69;
   G_io_apdu_buffer[1] = 0x82;
+  TRACE_APDU_OUT(G_io_apdu_buffer, 2);
+  // Send back the response and return without waiting for new APDU
+  io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, 2);
+  // Display back the original UX
+  ui_menu_main();
+}
+
+static void approve_batch() {
+
+  if (batch_count == 0) {
+    THROW(SW_INVALID_STATE);
+  }
+  stream_approve(INS_SIGN_BATCH);
+  batch_is_approved = true;
+
+  G_io_apdu_buffer[0] = batch_count;
+  G_io_apdu_buffer[1] = 0x90;
+  G_io_apdu_buffer[2] = 0x00;
+  TRACE_APDU_OUT(G_io_apdu_buffer, 3);
+  // Send back the response and return without waiting for new APDU
+  io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, 3);
+  // Display back the original UX
+  ui_menu_main();
+}
+
+/*
+** Writes the signatures of the approved batch, starting at the given index,
+** as many as fit on the response. Returns the response length.
+*/
+static unsigned int get_batch_signatures(unsigned int first) {
+
+  if (!batch_is_approved) {
+    THROW(SW_INVALID_STATE);
+  }
+  if (first >= (unsigned int) batch_count) {
+    THROW(SW_WRONG_P1P2);
+  }
+
+  return crypto_sign_batch(first, G_io_apdu_buffer, sizeof(G_io_apdu_buffer) - 2);
+
+}
+
+static void approve_abi() {
+
+  on_abi_approved();
+
+  G_io_apdu_buffer[0] = 0x90;
+  G_io_apdu_buffer[1] = 0x00;
+  TRACE_APDU_OUT(G_io_apdu_buffer, 2);
+  // Send back the response and return without waiting for new APDU
+  io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, 2);
+  // Display back the original UX
+  ui_menu_main();
+}
+
+static void approve_address() {
+
+  on_address_approved();
+
+  G_io_apdu_buffer[0] = 0x90;
+  G_io_apdu_buffer[1] = 0x00;
+  TRACE_APDU_OUT(G_io_apdu_buffer, 2);
+  // Send back the response and return without waiting for new APDU
+  io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, 2);
+  // Display back the original UX
+  ui_menu_main();
+}
+
+static void approve_policy() {
+
+  on_policy_approved();
+
+  G_io_apdu_buffer[0] = 0x90;
+  G_io_apdu_buffer[1] = 0x00;
+  TRACE_APDU_OUT(G_io_apdu_buffer, 2);
   // Send back the response and return without waiting for new APDU
   io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, 2);
   // Display back the original UX
   ui_menu_main();
 }
 
+/*
+** Ends the stream of parts when another command reuses its buffers on the
+** arena. Its review is dropped, so it cannot be approved anymore.
+*/
+static void end_stream() {
+  bool has_review = (stream_ins != 0 && stream_ins != INS_PARSE_TXN);
+
+  reset_stream();
+  signing_path_len = 0;
+  crypto_wipe_signing_key();
+  if (has_review) {
+    ui_menu_main();
+  }
+}
+
+static void send_extended_key() {
+  unsigned int tx;
+
+  /* only the path on the screen is exported */
+  stream_approve(INS_GET_EXTENDED_KEY);
+  tx = crypto_get_extended_key(arena.xkey.path, arena.xkey.path_len, G_io_apdu_buffer);
+  G_io_apdu_buffer[tx++] = 0x90;
+  G_io_apdu_buffer[tx++] = 0x00;
+  TRACE_APDU_OUT(G_io_apdu_buffer, tx);
+  // Send back the response and return without waiting for new APDU
+  io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, tx);
+  // Display back the original UX
+  ui_menu_main();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // TRANSACTION PARTS
 ////////////////////////////////////////////////////////////////////////////////
 
 static void request_first_part() {
+  STATS_INC(restreams);
   G_io_apdu_buffer[0] = 0x90;
   G_io_apdu_buffer[1] = 0x01;
+  TRACE_PART_REQUEST(1, 0x9001);
   // Send back the response and return without waiting for new APDU
   io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, 2);
 }
@@ -115,6 +278,7 @@ static void request_first_part() {
 static void request_next_part() {
   G_io_apdu_buffer[0] = 0x90;
   G_io_apdu_buffer[1] = 0x00;
+  TRACE_PART_REQUEST(0, 0x9000);
   // Send back the response and return without waiting for new APDU
   io_exchange(CHANNEL_APDU | IO_RETURN_AFTER_TX, 2);
 }
@@ -123,6 +287,10 @@ static void request_next_part() {
 // EXTERNAL FILES
 ////////////////////////////////////////////////////////////////////////////////
 
+#include "kv_store.h"
+
+#include "settings.h"
+
 #include "menu.h"
 
 #include "display_pages.h"
@@ -133,8 +301,20 @@ static void request_next_part() {
 
 #include "transaction.h"
 
+#include "envelope.h"
+
+#include "abi_registry.h"
+
+#include "address_book.h"
+
+#include "policy.h"
+
 #include "selection.h"
 
+#include "batch.h"
+
+#include "dry_run.h"
+
 ////////////////////////////////////////////////////////////////////////////////
 // APP MAIN LOOP
 ////////////////////////////////////////////////////////////////////////////////
@@ -170,12 +350,54 @@ void app_main() {
         if (rx < 5 || G_io_apdu_buffer[4] != rx - 5) {
           THROW(SW_WRONG_DATA_LENGTH);
         }
+        TRACE_APDU_IN(G_io_apdu_buffer);
 
         if (G_io_apdu_buffer[0] != CLA) {
           THROW(SW_CLA_NOT_SUPPORTED);
         }
 
+#ifdef HAVE_GET_SCREEN
+        // answered without changing the state of the command being reviewed
+        if (G_io_apdu_buffer[1] == INS_GET_SCREEN) {
+          tx = get_screen(G_io_apdu_buffer);
+          THROW(SW_OK);
+        }
+#endif
+
         cmd_type = G_io_apdu_buffer[1];
+        STATS_APDU(cmd_type);
+        STACK_COMMAND_START(cmd_type);
+
+        // a command that writes on the arena ends an unfinished stream of
+        // parts of another command, and its review
+        if (stream_is_ended_by(cmd_type)) {
+          end_stream();
+        }
+
+        // any other command ends the current batch or keys export. the
+        // read-only commands keep the state of the command being reviewed
+        if (!is_read_only_command(cmd_type)) {
+          if (cmd_type != INS_SIGN_BATCH) {
+            clear_batch();
+          }
+          if (cmd_type != INS_GET_PUBLIC_KEYS) {
+            keys_to_export = 0;
+          }
+          if (cmd_type != INS_SIGN_TXN && cmd_type != INS_SIGN_MSG) {
+            signing_path_len = 0;
+          }
+          if (cmd_type != INS_SIGN_TXN) {
+            payload_is_prehashed = false;
+            matched_policy = NULL;
+          }
+          if (cmd_type != INS_SIGN_TXN && cmd_type != INS_DECLARE_TXN) {
+            clear_envelope();
+          }
+          // set by the dry run for its parts only
+          gas_price_copy = NULL;
+          crypto_wipe_signing_key();
+        }
+
         switch (cmd_type) {
 
         case INS_GET_APP_VERSION: {
@@ -205,6 +427,43 @@ void app_main() {
           THROW(SW_OK);
         } break;
 
+        case INS_GET_PUBLIC_KEYS: {
+
+          if (G_io_apdu_buffer[2] & P1_FIRST) {
+            // the range is stored on the arena
+            end_stream();
+            if (crypto_start_key_range(G_io_apdu_buffer + 5, G_io_apdu_buffer[4]) == false) {
+              THROW(SW_WRONG_LENGTH);
+            }
+          } else if (keys_to_export == 0) {
+            THROW(SW_INVALID_STATE);
+          }
+
+          tx = crypto_next_public_keys(G_io_apdu_buffer, sizeof(G_io_apdu_buffer) - 2);
+          THROW(SW_OK);
+        } break;
+
+        case INS_GET_EXTENDED_KEY: {
+
+          // the path is stored on the arena
+          end_stream();
+          if (!crypto_parse_path(G_io_apdu_buffer + 5, G_io_apdu_buffer[4],
+                                 arena.xkey.path, &arena.xkey.path_len)) {
+            THROW(SW_WRONG_LENGTH);
+          }
+          if (!crypto_is_account_path(arena.xkey.path, arena.xkey.path_len)) {
+            THROW(SW_NOT_ALLOWED);
+          }
+
+          if (G_io_apdu_buffer[2] & P1_CONFIRM) {
+            on_export_extended_key();
+            flags |= IO_ASYNCH_REPLY;
+          } else {
+            tx = crypto_get_extended_key(arena.xkey.path, arena.xkey.path_len, G_io_apdu_buffer);
+            THROW(SW_OK);
+          }
+        } break;
+
         case INS_DISPLAY_ACCOUNT: {
 
           if (!account_selected) {
@@ -218,6 +477,91 @@ void app_main() {
         } break;
 
         case INS_SIGN_TXN: {
+          unsigned char *text;
+          unsigned int len, size;
+          bool is_first = false;
+          bool is_last = false;
+
+          if (G_io_apdu_buffer[2] & P1_FIRST) {
+            is_first = true;
+          }
+          if (G_io_apdu_buffer[2] & P1_LAST) {
+            is_last = true;
+          }
+          // check the message length
+          len = G_io_apdu_buffer[4];
+          if (len > 250) {
+            THROW(SW_WRONG_LENGTH);
+          }
+          text = G_io_apdu_buffer + 5;
+          // the signing path can be sent on the first part
+          if (is_first) {
+            payload_is_prehashed = false;
+            if (G_io_apdu_buffer[2] & P1_PREHASHED) {
+              if (!settings.prehashed_deploy) {
+                THROW(SW_NOT_ALLOWED);
+              }
+              payload_is_prehashed = true;
+            }
+            signing_path_len = 0;
+            if (G_io_apdu_buffer[2] & P1_PATH) {
+              size = crypto_read_signing_path(text, len);
+              text += size;
+              len -= size;
+            }
+            review_uses_path = (signing_path_len > 0);
+          }
+          if (!account_selected && signing_path_len == 0) {
+            THROW(SW_INVALID_STATE);
+          }
+          // each compressed part is decompressed on its own
+          if (G_io_apdu_buffer[2] & P1_COMPRESSED) {
+            int inflated_len = heatshrink_decode(text, len, arena.txn.inflated, sizeof arena.txn.inflated);
+            if (inflated_len < 0) {
+              THROW(SW_INVALID_COMPRESSED);
+            }
+            text = arena.txn.inflated;
+            len = inflated_len;
+          }
+          if (!is_last && len < 50) {
+            THROW(SW_WRONG_LENGTH);
+          }
+          //
+          on_new_transaction_part(text, len, is_first, is_last);
+          if (txn_is_complete) {
+            crypto_prepare_signing_key();
+          }
+          flags |= IO_ASYNCH_REPLY;
+        } break;
+
+        case INS_DECLARE_TXN: {
+          on_txn_envelope(G_io_apdu_buffer + 5, G_io_apdu_buffer[4]);
+          tx = 0;
+          THROW(SW_OK);
+        } break;
+
+        case INS_REGISTER_ABI: {
+          // the entry is stored on the arena
+          end_stream();
+          on_register_abi(G_io_apdu_buffer + 5, G_io_apdu_buffer[4]);
+          flags |= IO_ASYNCH_REPLY;
+        } break;
+
+        case INS_ADD_ADDRESS: {
+          // the entry is stored on the arena
+          end_stream();
+          on_add_address(G_io_apdu_buffer + 5, G_io_apdu_buffer[4]);
+          flags |= IO_ASYNCH_REPLY;
+        } break;
+
+        case INS_ADD_POLICY: {
+          // the entry is stored on the arena
+          end_stream();
+          on_add_policy(G_io_apdu_buffer + 5, G_io_apdu_buffer[4]);
+          flags |= IO_ASYNCH_REPLY;
+        } break;
+
+        case INS_SIGN_BATCH: {
           unsigned char *text;
           unsigned int len;
           bool is_first = false;
@@ -227,6 +571,39 @@ void app_main() {
             THROW(SW_INVALID_STATE);
           }
 
+          if (G_io_apdu_buffer[2] == P1_SIGNATURES) {
+            tx = get_batch_signatures(G_io_apdu_buffer[3]);
+            THROW(SW_OK);
+          }
+
+          if (G_io_apdu_buffer[2] & P1_FIRST) {
+            is_first = true;
+          }
+          if (G_io_apdu_buffer[2] & P1_LAST) {
+            is_last = true;
+          }
+          // check the message length
+          len = G_io_apdu_buffer[4];
+          if (len > 250) {
+            THROW(SW_WRONG_LENGTH);
+          }
+          //
+          text = G_io_apdu_buffer + 5;
+          on_new_batch_txn(text, len, is_first, is_last);
+          if (is_last) {
+            flags |= IO_ASYNCH_REPLY;
+          } else {
+            tx = 0;
+            THROW(SW_OK);
+          }
+        } break;
+
+        case INS_PARSE_TXN: {
+          unsigned char *text;
+          unsigned int len;
+          bool is_first = false;
+          bool is_last = false;
+
           if (G_io_apdu_buffer[2] & P1_FIRST) {
             is_first = true;
           }
@@ -243,33 +620,80 @@ void app_main() {
           }
           //
           text = G_io_apdu_buffer + 5;
-          on_new_transaction_part(text, len, is_first, is_last);
-          flags |= IO_ASYNCH_REPLY;
+          on_dry_run_part(text, len, is_first, is_last);
+          if (is_last) {
+            tx = get_dry_run_result(G_io_apdu_buffer);
+          }
+          THROW(SW_OK);
         } break;
 
         case INS_SIGN_MSG: {
           unsigned char *text;
-          unsigned int len;
+          unsigned int len, size;
           bool as_hex = false;
-
-          if (!account_selected) {
-            THROW(SW_INVALID_STATE);
-          }
+          bool is_first, is_last;
 
           if (G_io_apdu_buffer[2] & P1_HEX) {
             as_hex = true;
           }
+          get_message_part(G_io_apdu_buffer[2], &is_first, &is_last);
           // check the message length
           len = G_io_apdu_buffer[4];
           if (len > 250) {
             THROW(SW_WRONG_LENGTH);
           }
-          //
           text = G_io_apdu_buffer + 5;
-          on_new_message(text, len, as_hex);
+          // the signing path can be sent before the message
+          if (is_first) {
+            signing_path_len = 0;
+            if (G_io_apdu_buffer[2] & P1_PATH) {
+              size = crypto_read_signing_path(text, len);
+              text += size;
+              len -= size;
+            }
+            review_uses_path = (signing_path_len > 0);
+          }
+          if (!account_selected && signing_path_len == 0) {
+            THROW(SW_INVALID_STATE);
+          }
+          //
+          on_new_message(text, len, as_hex, is_first, is_last);
+          if (txn_is_complete) {
+            crypto_prepare_signing_key();
+          }
           flags |= IO_ASYNCH_REPLY;
         } break;
 
+#ifdef HAVE_STATS
+        case INS_GET_STATS: {
+          tx = get_stats(G_io_apdu_buffer);
+          if (G_io_apdu_buffer[2] & P1_RESET) {
+            stats_reset();
+          }
+          THROW(SW_OK);
+        } break;
+#endif
+
+#ifdef HAVE_TRACE
+        case INS_GET_TRACE: {
+          tx = get_trace(G_io_apdu_buffer, G_io_apdu_buffer[3]);
+          if (G_io_apdu_buffer[2] & P1_RESET) {
+            trace_reset();
+          }
+          THROW(SW_OK);
+        } break;
+#endif
+
+#ifdef HAVE_STACK_USAGE
+        case INS_GET_STACK_USAGE: {
+          tx = get_stack_usage(G_io_apdu_buffer);
+          if (G_io_apdu_buffer[2] & P1_RESET) {
+            stack_reset();
+          }
+          THROW(SW_OK);
+        } break;
+#endif
+
         default:
           THROW(SW_INS_NOT_SUPPORTED);
           break;
@@ -279,6 +703,9 @@ void app_main() {
         THROW(EXCEPTION_IO_RESET);
       }
       CATCH_OTHER(e) {
+        if (e != SW_OK) {
+          TRACE_EXCEPTION(e);
+        }
         switch (e & 0xF000) {
         case 0x6000:
         case SW_OK:
@@ -292,11 +719,16 @@ void app_main() {
         G_io_apdu_buffer[tx] = sw >> 8;
         G_io_apdu_buffer[tx + 1] = sw;
         tx += 2;
+        TRACE_APDU_OUT(G_io_apdu_buffer, tx);
       }
       FINALLY {
       }
     }
     END_TRY;
+
+    // the review is shown: derive its signing key before waiting for the
+    // user, so the approval only runs the signature
+    crypto_derive_signing_key();
   }
 
 }
@@ -305,6 +737,8 @@ void app_main() {
  * Exit the application and go back to the dashboard.
  */
 void app_exit() {
+  key_cache_clear();
+  crypto_wipe_signing_key();
   BEGIN_TRY_L(exit) {
     TRY_L(exit) {
       os_sched_exit(-1);
@@ -328,6 +762,8 @@ __attribute__((section(".boot"))) int main(void) {
   while (1) {
 
     account_selected = false;
+    key_cache_clear();
+    crypto_wipe_signing_key();
     txn_is_complete = true;
     page_to_display = 0;
     input_pos = 0;
@@ -350,6 +786,13 @@ __attribute__((section(".boot"))) int main(void) {
         USB_power(0);
         USB_power(1);
 
+        kv_init();
+        settings_init();
+        display_font_init();
+        stats_reset();
+        trace_reset();
+        stack_reset();
+
         ui_menu_main();
 
         app_main();
@@ -17,22 +17,26 @@
 
 UX_STEP_NOCB(ux_menu_ready_step, pnn, {&C_aergo_logo, "Aergo app", "is ready"});
 UX_STEP_NOCB(ux_menu_version_step, bn, {"Version", APPVERSION});
+UX_STEP_CB(ux_menu_settings_step, pb, ui_menu_settings(NULL), {&C_icon_coggle, "Settings"});
 UX_STEP_CB(ux_menu_about_step, pb, ui_menu_about(), {&C_icon_certificate, "About"});
-UX_STEP_VALID(ux_menu_exit_step, pb, os_sched_exit(-1), {&C_icon_dashboard_x, "Quit"});
+UX_STEP_VALID(ux_menu_exit_step, pb, app_exit(), {&C_icon_dashboard_x, "Quit"});
 
 // FLOW for the main menu:
 // #1 screen: ready
 // #2 screen: version of the app
-// #3 screen: about submenu
-// #4 screen: quit
+// #3 screen: settings submenu
+// #4 screen: about submenu
+// #5 screen: quit
 UX_FLOW(ux_menu_main_flow,
         &ux_menu_ready_step,
         &ux_menu_version_step,
+        &ux_menu_settings_step,
         &ux_menu_about_step,
         &ux_menu_exit_step,
         FLOW_LOOP);
 
 void ui_menu_main() {
+  SCREEN_STRINGS("", "");
   if (G_ux.stack_count == 0) {
     ux_stack_push();
   }
@@ -51,3 +55,121 @@ UX_FLOW(ux_menu_about_flow, &ux_menu_info_step, &ux_menu_back_step, FLOW_LOOP);
 void ui_menu_about() {
   ux_flow_init(0, ux_menu_about_flow, NULL);
 }
+
+static char prehashed_deploy_value[10];
+static char page_limit_value[4];
+static char binary_payload_value[8];
+
+static void toggle_prehashed_deploy();
+static void change_page_limit();
+static void toggle_binary_payload();
+static void clear_abi_registry();
+static void clear_address_book();
+static void clear_policies();
+
+UX_STEP_CB(ux_settings_prehashed_step, bn, toggle_prehashed_deploy(), {"Deploy by hash", prehashed_deploy_value});
+UX_STEP_CB(ux_settings_pages_step, bn, change_page_limit(), {"Payload pages", page_limit_value});
+UX_STEP_CB(ux_settings_binary_step, bn, toggle_binary_payload(), {"Binary payload", binary_payload_value});
+UX_STEP_CB(ux_settings_abi_step, bn, clear_abi_registry(), {"Contract ABIs", "Clear all"});
+UX_STEP_CB(ux_settings_address_step, bn, clear_address_book(), {"Address book", "Clear all"});
+UX_STEP_CB(ux_settings_policy_step, bn, clear_policies(), {"Signing policies", "Clear all"});
+UX_STEP_CB(ux_settings_back_step, pb, ui_menu_main(), {&C_icon_back, "Back"});
+
+// FLOW for the settings submenu:
+// #1 screen: accept deployments with the payload hash (toggle)
+// #2 screen: pages displayed from long payloads (4, 8, 16 or all)
+// #3 screen: display binary payloads in hex (toggle)
+// #4 screen: clear the registered contract ABIs
+// #5 screen: clear the address book
+// #6 screen: clear the signing policies
+// #7 screen: back button to main menu
+UX_FLOW(ux_menu_settings_flow,
+        &ux_settings_prehashed_step,
+        &ux_settings_pages_step,
+        &ux_settings_binary_step,
+        &ux_settings_abi_step,
+        &ux_settings_address_step,
+        &ux_settings_policy_step,
+        &ux_settings_back_step,
+        FLOW_LOOP);
+
+void ui_menu_settings(const ux_flow_step_t *const start_step) {
+  static const char *page_limits[] = {"4", "8", "16", "All"};
+  uint8_t page_limit = settings.page_limit;
+
+  if (page_limit > PAGE_LIMIT_ALL) page_limit = PAGE_LIMIT_4;
+
+  strcpy(prehashed_deploy_value, settings.prehashed_deploy ? "Enabled" : "Disabled");
+  strcpy(page_limit_value, (const char *)PIC(page_limits[page_limit]));
+  strcpy(binary_payload_value, settings.binary_as_hex ? "Hex" : "Text");
+  ux_flow_init(0, ux_menu_settings_flow, start_step);
+}
+
+static void toggle_prehashed_deploy() {
+  settings_set_prehashed_deploy(!settings.prehashed_deploy);
+  ui_menu_settings(&ux_settings_prehashed_step);
+}
+
+static void change_page_limit() {
+  settings_set_page_limit((settings.page_limit + 1) % (PAGE_LIMIT_ALL + 1));
+  ui_menu_settings(&ux_settings_pages_step);
+}
+
+static void toggle_binary_payload() {
+  settings_set_binary_as_hex(!settings.binary_as_hex);
+  ui_menu_settings(&ux_settings_binary_step);
+}
+
+// the step of the table to clear, after the confirmation
+static const ux_flow_step_t *clear_step;
+static char clear_name[20];
+
+static void confirm_clear();
+static void cancel_clear();
+
+UX_STEP_NOCB(ux_clear_warning_step, pnn, {&C_icon_warning, "Clear all", clear_name});
+UX_STEP_CB(ux_clear_confirm_step, pb, confirm_clear(), {&C_icon_validate_14, "Confirm"});
+UX_STEP_CB(ux_clear_cancel_step, pb, cancel_clear(), {&C_icon_crossmark, "Cancel"});
+
+// FLOW to confirm the erase of a table:
+// #1 screen: warning with the name of the table
+// #2 screen: confirm button
+// #3 screen: cancel button, back to the settings
+UX_FLOW(ux_clear_flow,
+        &ux_clear_warning_step,
+        &ux_clear_confirm_step,
+        &ux_clear_cancel_step,
+        FLOW_LOOP);
+
+static void ask_clear(const ux_flow_step_t *step, const char *name) {
+  clear_step = step;
+  strcpy(clear_name, name);
+  ux_flow_init(0, ux_clear_flow, NULL);
+}
+
+static void confirm_clear() {
+  if (clear_step == &ux_settings_abi_step) {
+    abi_clear_registry();
+  } else if (clear_step == &ux_settings_address_step) {
+    address_book_clear();
+  } else if (clear_step == &ux_settings_policy_step) {
+    policy_clear_all();
+  }
+  ui_menu_settings(clear_step);
+}
+
+static void cancel_clear() {
+  ui_menu_settings(clear_step);
+}
+
+static void clear_abi_registry() {
+  ask_clear(&ux_settings_abi_step, "Contract ABIs");
+}
+
+static void clear_address_book() {
+  ask_clear(&ux_settings_address_step, "Address book");
+}
+
+static void clear_policies() {
+  ask_clear(&ux_settings_policy_step, "Signing policies");
+}
@@ -0,0 +1,270 @@
+////////////////////////////////////////////////////////////////////////////////
+// SIGNING POLICIES
+////////////////////////////////////////////////////////////////////////////////
+
+// Templates of recurring transactions, stored on the flash memory (NVM).
+// They are added by the host, one at a time, after the user approves them
+// on the device.
+// A policy has the recipient, the function, the chain ID, the maximum amount
+// and a window of accepted nonces. A transaction that matches it is signed
+// after a single confirmation screen, instead of the full review. Anything
+// else is displayed as usual.
+// The nonces only move forward: after a transaction is signed, the next ones
+// must use a higher nonce, so the same transaction cannot be signed twice.
+// The entries are indexed by a hash of the recipient and the function, using
+// open addressing with linear probing, like the contract ABI registry.
+
+#ifndef N_policy_table
+const struct policy_entry N_policy_table_real[POLICY_TABLE_SIZE];
+#define N_policy_table ((struct policy_entry *)PIC(N_policy_table_real))
+#endif
+
+// FNV-1a hash of the recipient and the function. 0 is used to mark empty entries.
+static uint32_t policy_key(const unsigned char *recipient, unsigned int recipient_len,
+                           const char *function, unsigned int len) {
+  uint32_t hash = 2166136261u;
+  unsigned int i;
+
+  for (i = 0; i < recipient_len; i++) {
+    hash = (hash ^ recipient[i]) * 16777619u;
+  }
+  hash = (hash ^ 0xFF) * 16777619u;  // separator
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char) function[i]) * 16777619u;
+  }
+
+  return hash ? hash : 1;
+}
+
+static bool policy_entry_matches(struct policy_entry *entry, uint32_t key,
+                                 const unsigned char *recipient, unsigned int recipient_len,
+                                 const char *function, unsigned int len) {
+  return (entry->key == key &&
+          entry->recipient_len == recipient_len &&
+          memcmp(entry->recipient, recipient, recipient_len) == 0 &&
+          strlen(entry->function) == len &&
+          memcmp(entry->function, function, len) == 0);
+}
+
+/*
+** Returns the slot of the given policy or, if not stored, the empty slot
+** where it would be stored. Returns -1 if the table is full.
+*/
+static int policy_find_slot(uint32_t key, const unsigned char *recipient, unsigned int recipient_len,
+                            const char *function, unsigned int len) {
+  unsigned int i, slot = key % POLICY_TABLE_SIZE;
+
+  for (i = 0; i < POLICY_TABLE_SIZE; i++) {
+    struct policy_entry *entry = &N_policy_table[slot];
+    if (entry->key == 0 ||
+        policy_entry_matches(entry, key, recipient, recipient_len, function, len)) {
+      return slot;
+    }
+    slot = (slot + 1) % POLICY_TABLE_SIZE;
+  }
+
+  return -1;
+}
+
+static struct policy_entry * policy_lookup(const unsigned char *recipient, unsigned int recipient_len,
+                                           const char *function, unsigned int len) {
+  uint32_t key = policy_key(recipient, recipient_len, function, len);
+  int slot = policy_find_slot(key, recipient, recipient_len, function, len);
+
+  if (slot < 0 || N_policy_table[slot].key == 0) {
+    return NULL;
+  }
+  return &N_policy_table[slot];
+}
+
+static void policy_store(struct policy_entry *entry) {
+  int slot = policy_find_slot(entry->key, entry->recipient, entry->recipient_len,
+                              entry->function, strlen(entry->function));
+
+  if (slot < 0) {
+    THROW(SW_POLICY_TABLE_FULL);
+  }
+  nvm_write((void *)&N_policy_table[slot], entry, sizeof(struct policy_entry));
+}
+
+static inline void policy_clear_all() {
+  uint32_t empty = 0;
+  int i;
+
+  for (i = 0; i < POLICY_TABLE_SIZE; i++) {
+    if (N_policy_table[i].key != 0) {
+      nvm_write((void *)&N_policy_table[i].key, &empty, sizeof(empty));
+    }
+  }
+}
+
+/*
+** Called when the transaction that matches a policy is signed. The next
+** ones must use a higher nonce.
+*/
+static void policy_mark_used() {
+  uint64_t next_nonce = txn.nonce + 1;
+  nvm_write((void *)&matched_policy->next_nonce, &next_nonce, sizeof(next_nonce));
+  matched_policy = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// REGISTRATION
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t read_uint64_be(unsigned char *buf) {
+  return ((uint64_t)read_uint32_be(buf) << 32) | read_uint32_be(buf + 4);
+}
+
+/*
+** The entry is sent as:
+**   recipient length (1) | recipient | function name length (1) |
+**   function name | chain ID (32) | max amount length (1) | max amount |
+**   first nonce (8) | nonce window (4)
+*/
+static void on_add_policy(unsigned char *buf, unsigned int len) {
+  struct policy_entry *entry = &arena.policy.entry;
+  unsigned char empty[32] = {0};
+  unsigned int pos = 0, size, n;
+  uint64_t last_nonce;
+
+  memset(entry, 0, sizeof(struct policy_entry));
+
+  /* recipient: an address or a name, like aergo.system */
+  if (len < 1) THROW(SW_WRONG_LENGTH);
+  size = buf[pos++];
+  if (pos + size + 1 > len) THROW(SW_WRONG_LENGTH);
+  if (size == 0 || size > POLICY_RECIPIENT_LEN) THROW(SW_INVALID_POLICY);
+  if (size != 33 && !is_valid_abi_name(buf + pos, size, 30)) THROW(SW_INVALID_POLICY);
+  memcpy(entry->recipient, buf + pos, size);
+  entry->recipient_len = size;
+  pos += size;
+
+  size = buf[pos++];
+  if (pos + size + 32 + 1 > len) THROW(SW_WRONG_LENGTH);
+  if (!is_valid_abi_name(buf + pos, size, ABI_FUNCTION_LEN)) THROW(SW_INVALID_POLICY);
+  memcpy(entry->function, buf + pos, size);
+  pos += size;
+
+  memcpy(entry->chain_id, buf + pos, 32);
+  pos += 32;
+  if (memcmp(entry->chain_id, empty, 32) == 0) THROW(SW_INVALID_POLICY);
+
+  size = buf[pos++];
+  if (pos + size + 8 + 4 != len) THROW(SW_WRONG_LENGTH);
+  if (size == 0 || size > 15) THROW(SW_INVALID_POLICY);
+  memcpy(entry->max_amount + sizeof(entry->max_amount) - size, buf + pos, size);
+  pos += size;
+
+  entry->next_nonce = read_uint64_be(buf + pos);
+  entry->nonce_window = read_uint32_be(buf + pos + 8);
+  if (entry->nonce_window == 0) THROW(SW_INVALID_POLICY);
+  last_nonce = entry->next_nonce + entry->nonce_window - 1;
+  if (last_nonce < entry->next_nonce) THROW(SW_INVALID_POLICY);
+
+  entry->key = policy_key(entry->recipient, entry->recipient_len,
+                          entry->function, strlen(entry->function));
+
+  /* check if there is space before asking the user */
+  if (policy_find_slot(entry->key, entry->recipient, entry->recipient_len,
+                       entry->function, strlen(entry->function)) < 0) {
+    THROW(SW_POLICY_TABLE_FULL);
+  }
+
+  if (entry->recipient_len == 33) {
+    encode_account(entry->recipient, 33, arena.policy.recipient, sizeof arena.policy.recipient);
+  } else {
+    memcpy(arena.policy.recipient, entry->recipient, entry->recipient_len);
+    arena.policy.recipient[entry->recipient_len] = 0;
+  }
+  encode_amount(entry->max_amount, sizeof(entry->max_amount), arena.policy.max_amount, sizeof arena.policy.max_amount);
+  n = format_hex(arena.policy.chain_id, entry->chain_id, 32);
+  arena.policy.chain_id[n] = 0;
+  /* the range of accepted nonces, like: 11 to 110 */
+  n = format_uint64(arena.policy.nonces, entry->next_nonce);
+  memcpy(arena.policy.nonces + n, " to ", 4);
+  n += 4;
+  n += format_uint64(arena.policy.nonces + n, last_nonce);
+  arena.policy.nonces[n] = 0;
+
+  clear_screens();
+  max_pages = 0;
+  add_screens("Recipient", arena.policy.recipient, strlen(arena.policy.recipient), false);
+  add_screens("Function", entry->function, strlen(entry->function), false);
+  add_screens("Max Amount", arena.policy.max_amount, strlen(arena.policy.max_amount), false);
+  add_screens("Chain ID", arena.policy.chain_id, 64, false);
+  add_screens("Nonces", arena.policy.nonces, n, false);
+
+  /* the entry on the arena waits for the approval */
+  stream_part(INS_ADD_POLICY, true);
+
+  is_signing = false;
+  is_first_part = true;
+  is_last_part = true;
+  txn_is_complete = true;
+  display_proper_page();
+
+}
+
+/*
+** Called when the user approves the policy. It is stored only if it is still
+** the one displayed: a command that writes on the arena ends the review.
+*/
+static void on_policy_approved() {
+  stream_approve(INS_ADD_POLICY);
+  policy_store(&arena.policy.entry);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MATCHING
+////////////////////////////////////////////////////////////////////////////////
+
+// is the transaction amount up to the maximum amount of the policy?
+static bool is_amount_allowed(struct policy_entry *entry) {
+  unsigned char amount[16] = {0};
+
+  if (txn.amount_len > sizeof(amount)) return false;
+  memcpy(amount + sizeof(amount) - txn.amount_len, txn.amount, txn.amount_len);
+
+  return memcmp(amount, entry->max_amount, sizeof(amount)) <= 0;
+}
+
+/*
+** Checks if the transaction matches a stored policy. Only complete
+** transactions sent in a single part are checked, with the payload calling
+** a function. If it matches, sets the text of the confirmation screen.
+*/
+static bool match_signing_policy() {
+  struct policy_entry *entry;
+  char *function_name, *args;
+  unsigned int name_len, args_len, n;
+
+  matched_policy = NULL;
+
+  if (!txn_is_complete || has_partial_payload || !txn.payload || !txn.recipient) {
+    return false;
+  }
+  if (txn_type != TXN_GOVERNANCE && txn_type != TXN_CALL && txn_type != TXN_FEEDELEGATION) {
+    return false;
+  }
+  if (!parse_payload(&function_name, &name_len, &args, &args_len)) return false;
+
+  entry = policy_lookup(txn.recipient, txn.recipient_len, function_name, name_len);
+  if (!entry) return false;
+
+  if (memcmp(txn.chainId, entry->chain_id, 32) != 0 ||
+      !is_amount_allowed(entry) ||
+      txn.nonce < entry->next_nonce ||
+      txn.nonce - entry->next_nonce >= entry->nonce_window) {
+    return false;
+  }
+
+  /* like: v1stake, 100 AERGO */
+  n = strlen(entry->function);
+  memcpy(arena.txn.policy_text, entry->function, n);
+  memcpy(arena.txn.policy_text + n, ", ", 2);
+  strlcpy(arena.txn.policy_text + n + 2, arena.txn.amount_str, sizeof(arena.txn.policy_text) - n - 2);
+
+  matched_policy = entry;
+  return true;
+}
@@ -1,21 +1,28 @@
 
+bool is_simple_transfer() {
+  return (txn_type == TXN_TRANSFER && txn.payload == NULL && txn_is_complete);
+}
+
 static void display_payload_hash() {
-  int i, start_screen = num_screens;
+  int i, start_field = num_fields;
 
-  /* calculate the payload hash */
-  sha256_finish(hash2, payload_hash);
+  /* calculate the payload hash, if not sent by the host */
+  if (!payload_is_prehashed) {
+    sha256_finish(arena.txn.hash2, arena.txn.payload_hash);
+  }
 
-  add_screens("New Contract 1/6", (char*)payload_hash +  0, 6, false);
-  add_screens("New Contract 2/6", (char*)payload_hash +  6, 6, false);
-  add_screens("New Contract 3/6", (char*)payload_hash + 12, 6, false);
-  add_screens("New Contract 4/6", (char*)payload_hash + 18, 6, false);
-  add_screens("New Contract 5/6", (char*)payload_hash + 24, 6, false);
-  add_screens("New Contract 6/6", (char*)payload_hash + 30, 2, false);
+  add_screens("New Contract 1/6", (char*)arena.txn.payload_hash +  0, 6, false);
+  add_screens("New Contract 2/6", (char*)arena.txn.payload_hash +  6, 6, false);
+  add_screens("New Contract 3/6", (char*)arena.txn.payload_hash + 12, 6, false);
+  add_screens("New Contract 4/6", (char*)arena.txn.payload_hash + 18, 6, false);
+  add_screens("New Contract 5/6", (char*)arena.txn.payload_hash + 24, 6, false);
+  add_screens("New Contract 6/6", (char*)arena.txn.payload_hash + 30, 2, false);
 
   /* display the payload hash in hex format */
-  for (i=start_screen; i<num_screens; i++) {
-    screens[i].in_hex = true;
+  for (i=start_field; i<num_fields; i++) {
+    fields[i].in_hex = true;
   }
+  count_screens();
 
   /* to avoid asking for txn parts again */
   is_first_part = true;
@@ -23,6 +30,33 @@ static void display_payload_hash() {
 
 }
 
+/* does the received part of the payload have control characters? */
+static bool is_binary_payload() {
+  unsigned int i;
+
+  for (i = 0; i < txn.payload_part_len; i++) {
+    unsigned char c = txn.payload[i];
+    if (c < 0x20 && c != '\n' && c != '\r' && c != '\t') {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void add_payload_screens() {
+
+  add_screens("Payload", txn.payload, txn.payload_part_len, true);
+
+  /* binary payloads can be displayed in hex */
+  if (settings.binary_as_hex && is_binary_payload()) {
+    fields[num_fields-1].in_hex = true;
+  }
+
+  /* if the payload is long, display only the first pages */
+  if (txn.payload_len >= 50) max_pages = settings_max_pages();
+
+}
+
 static void display_transaction() {
   unsigned int pos = 0;
   char *function_name, *args;
@@ -31,8 +65,11 @@ static void display_transaction() {
   clear_screens();
   max_pages = 0;
 
-  if (strcmp(amount_str,"0 AERGO") != 0 && !txn.is_system) {
-    add_screens("Amount", amount_str, strlen(amount_str), false);
+  /* is the recipient on the address book? */
+  lookup_recipient_label();
+
+  if (strcmp(arena.txn.amount_str,"0 AERGO") != 0 && !txn.is_system) {
+    add_screens("Amount", arena.txn.amount_str, strlen(arena.txn.amount_str), false);
   }
 
   /* determine what to display according to the transaction type */
@@ -42,13 +79,11 @@ static void display_transaction() {
     //pos = 1;
 
     if (num_screens == 0) {
-      add_screens("Amount", amount_str, strlen(amount_str), false);
+      add_screens("Amount", arena.txn.amount_str, strlen(arena.txn.amount_str), false);
     }
-    add_screens("Recipient", recipient_address, strlen(recipient_address), false);
+    add_recipient_screens("Recipient");
     if (txn.payload) {
-      add_screens("Payload", txn.payload, txn.payload_part_len, true);
-      /* if the payload is long, display only the first pages */
-      if (txn.payload_len >= 50) max_pages = 4;
+      add_payload_screens();
     }
 
     break;
@@ -60,15 +95,17 @@ static void display_transaction() {
 
     /* set the screens to be displayed */
 
-    add_screens("Contract", recipient_address, strlen(recipient_address), false);
+    add_recipient_screens("Contract");
 
-    if (txn.payload) {
+    if (txn.payload && display_call_with_abi()) {
+      /* each argument is displayed with its registered name */
+    } else if (txn.payload) {
       /* parse the payload */
       /* {"Name":"some_function","Args":[<parameters>]} */
       if (parse_payload_function(&function_name, &size) == false) goto loc_invalid;
       add_screens("Function", function_name, size, true);
-      screens[num_screens-1].is_call = true;
-      screens[num_screens-1].trim_payload = true;
+      fields[num_fields-1].is_call = true;
+      fields[num_fields-1].trim_payload = true;
       //add_screens("Parameters", args, size, true);
     } else {
       function_name = "default";
@@ -89,7 +126,7 @@ static void display_transaction() {
     }
 
     add_screens("MultiCall", txn.payload+1, txn.payload_part_len-1, true);
-    screens[num_screens-1].is_multicall = true;
+    fields[num_fields-1].is_multicall = true;
 
     break;
 
@@ -107,34 +144,34 @@ static void display_transaction() {
       // {"Name":"v1stake"}
       if (strncmp(function_name,"v1stake",name_len) == 0) {
 
-        add_screens("Stake", amount_str, strlen(amount_str), true);
+        add_screens("Stake", arena.txn.amount_str, strlen(arena.txn.amount_str), true);
 
       // {"Name":"v1unstake"}
       } else if (strncmp(function_name,"v1unstake",name_len) == 0) {
 
-        add_screens("Unstake", amount_str, strlen(amount_str), true);
+        add_screens("Unstake", arena.txn.amount_str, strlen(arena.txn.amount_str), true);
 
       // {"Name":"v1voteBP","Args":[<peer IDs>]}
       } else if (strncmp(function_name,"v1voteBP",name_len) == 0) {
 
         if (!args) goto loc_invalid;
 
-        if (strcmp(amount_str,"0 AERGO") != 0) {
-          add_screens("Amount", amount_str, strlen(amount_str), false);
+        if (strcmp(arena.txn.amount_str,"0 AERGO") != 0) {
+          add_screens("Amount", arena.txn.amount_str, strlen(arena.txn.amount_str), false);
         }
         add_screens("BP Vote", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       // {"Name":"v1voteDAO","Args":[<DAO ID>,<candidate>]}
       } else if (strncmp(function_name,"v1voteDAO",name_len) == 0) {
 
         if (!args) goto loc_invalid;
 
-        if (strcmp(amount_str,"0 AERGO") != 0) {
-          add_screens("Amount", amount_str, strlen(amount_str), false);
+        if (strcmp(arena.txn.amount_str,"0 AERGO") != 0) {
+          add_screens("Amount", arena.txn.amount_str, strlen(arena.txn.amount_str), false);
         }
         add_screens("DAO Vote", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       } else {
         pos = 6;
@@ -151,13 +188,13 @@ static void display_transaction() {
       if (strncmp(function_name,"v1createName",name_len) == 0) {
 
         add_screens("Create Name", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       // {"Name":"v1updateName","Args":[<a name string>, <new owner address>]}
       } else if (strncmp(function_name,"v1updateName",name_len) == 0) {
 
         add_screens("Update Name", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       } else {
         pos = 8;
@@ -174,37 +211,37 @@ static void display_transaction() {
       if (strncmp(function_name,"appendAdmin",name_len) == 0) {
 
         add_screens("Add Admin", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       // {"Name":"removeAdmin","Args":[<admin address>]}
       } else if (strncmp(function_name,"removeAdmin",name_len) == 0) {
 
         add_screens("Remove Admin", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       // {"Name":"appendConf","Args":[<config key>,<config value>]}
       } else if (strncmp(function_name,"appendConf",name_len) == 0) {
 
         add_screens("Add Config", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       // {"Name":"removeConf","Args":[<config key>,<config value>]}
       } else if (strncmp(function_name,"removeConf",name_len) == 0) {
 
         add_screens("Remove Config", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       // {"Name":"enableConf","Args":[<config key>,<true|false>]}
       } else if (strncmp(function_name,"enableConf",name_len) == 0) {
 
         add_screens("Enable Config", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       // {"Name":"changeCluster","Args":[{"command":"add","name":"[node name]","address":"[peer address]","peerid":"[peer id]"}]}
       } else if (strncmp(function_name,"changeCluster",name_len) == 0) {
 
         add_screens("Change Cluster", args, size, true);
-        screens[num_screens-1].trim_payload = true;
+        fields[num_fields-1].trim_payload = true;
 
       } else {
         pos = 10;
@@ -230,7 +267,7 @@ static void display_transaction() {
 
     //pos = 13;
 
-    add_screens("Redeploy", recipient_address, strlen(recipient_address), false);
+    add_recipient_screens("Redeploy");
     display_payload_hash();
 
     break;
@@ -239,13 +276,11 @@ static void display_transaction() {
 
     pos = 14;
 
-    if (recipient_address[0] != 0) {
-      add_screens("Recipient", recipient_address, strlen(recipient_address), false);
+    if (arena.txn.recipient_address[0] != 0) {
+      add_recipient_screens("Recipient");
     }
     if (txn.payload) {
-      add_screens("Payload", txn.payload, txn.payload_part_len, true);
-      /* if the payload is long, display only the first pages */
-      if (txn.payload_len >= 50) max_pages = 4;
+      add_payload_screens();
     }
 
     if (num_screens == 0) {
@@ -260,6 +295,9 @@ static void display_transaction() {
   }
 
 
+  /* show the part number on long declared transactions */
+  show_part_progress();
+
   /* display the first or expected page */
   display_proper_page();
 
@@ -272,8 +310,10 @@ loc_invalid:
 
 static void display_txn_part() {
 
-  screens[num_screens-1].text = txn.payload;
-  screens[num_screens-1].size = txn.payload_part_len;
+  fields[num_fields-1].text = txn.payload;
+  fields[num_fields-1].size = txn.payload_part_len;
+
+  show_part_progress();
 
   display_new_input();
 
@@ -282,14 +322,24 @@ static void display_txn_part() {
 static void on_new_transaction_part(unsigned char *buf, unsigned int len, bool is_first, bool is_last){
   bool is_payload_part = (!is_first && has_partial_payload);
 
+  stream_part(INS_SIGN_TXN, is_first);
+
   parse_transaction_part(buf, len, is_first, is_last);
 
+  check_envelope_part(len, is_first);
+
   is_signing = true;
 
-  if (txn_type == TXN_DEPLOY || txn_type == TXN_REDEPLOY) {
+  STATS_BEGIN();
+
+  if (is_first && match_signing_policy()) {
+    /* a single confirmation screen */
+    start_display();
+  } else if (txn_type == TXN_DEPLOY || txn_type == TXN_REDEPLOY) {
     if (txn_is_complete) {
       display_transaction();
     } else {
+      show_receiving_progress();
       request_next_part();
     }
   } else if (is_first) {
@@ -300,34 +350,107 @@ static void on_new_transaction_part(unsigned char *buf, unsigned int len, bool i
     display_proper_page();
   }
 
+  STATS_END(STATS_RENDER);
 }
 
-static void on_new_message(unsigned char *text, unsigned int len, bool as_hex){
+/*
+** Reads the position of a message part from P1. A message in a single
+** command has no part flags, or both the first and last ones. The parts
+** between the first and the last one have the middle part flag.
+*/
+static void get_message_part(unsigned char p1, bool *is_first, bool *is_last) {
+  *is_first = (p1 & P1_FIRST) != 0;
+  *is_last = (p1 & P1_LAST) != 0;
+  if (!*is_first && !*is_last && !(p1 & P1_MIDDLE)) {
+    *is_first = true;
+    *is_last = true;
+  }
+}
 
-  /* calculate the message hash */
-  sha256(txn_hash, text, len);
+static void on_new_message(unsigned char *text, unsigned int len, bool as_hex, bool is_first, bool is_last){
 
-  /* display the message */
-  clear_screens();
-  add_screens("Message", (char*)text, len, true);
-  screens[num_screens-1].in_hex = as_hex;
+  stream_part(INS_SIGN_MSG, is_first);
+
+  /* the next parts continue the same message */
+  if (!is_first && (txn_is_complete || as_hex != arena.msg.as_hex)) {
+    THROW(SW_INVALID_STATE);
+  }
+
+  /* calculate the message hash, one part at a time */
+  if (is_first) {
+    sha256_init(arena.msg.hash);
+    arena.msg.as_hex = as_hex;
+  }
+  sha256_add(arena.msg.hash, text, len);
+  if (is_last) {
+    sha256_finish(arena.msg.hash, txn_hash);
+  }
 
   is_signing = true;
+  is_first_part = is_first;
+  is_last_part = is_last;
+  txn_is_complete = is_last;
+  has_partial_payload = !is_last;
+
+  if (is_first) {
+    /* display the message */
+    clear_screens();
+    max_pages = 0;
+    add_screens("Message", (char*)text, len, true);
+    fields[num_fields-1].in_hex = as_hex;
+    display_proper_page();
+  } else {
+    /* continue displaying the message with the new part */
+    fields[num_fields-1].text = (char*)text;
+    fields[num_fields-1].size = len;
+    display_new_input();
+  }
+
+}
+
+static void on_display_account(unsigned char *pubkey, int pklen){
+  char *address = arena.account.address;
+
+  /* encode the public key into the account address, once per cached account */
+  if (selected_key) {
+    address = selected_key->address;
+    if (address[0] == 0) {
+      encode_account(pubkey, pklen, address, sizeof selected_key->address);
+    }
+  } else {
+    encode_account(pubkey, pklen, address, sizeof arena.account.address);
+  }
+
+  /* display the account address */
+  clear_screens();
+  add_screens("Account", address, strlen(address), false);
+
+  is_signing = false;
   is_first_part = true;
   is_last_part = true;
   txn_is_complete = true;
+  reset_display_state();
   display_proper_page();
 
 }
 
-static void on_display_account(unsigned char *pubkey, int pklen){
+static void on_export_extended_key(){
+  unsigned int i, pos = 0;
 
-  /* encode the public key into the account address */
-  encode_account(pubkey, pklen, recipient_address, sizeof recipient_address);
+  /* format the path as 44'/441'/0' */
+  for (i = 0; i < arena.xkey.path_len; i++) {
+    if (i > 0) arena.xkey.path_str[pos++] = '/';
+    pos += format_uint(arena.xkey.path_str + pos, arena.xkey.path[i] & 0x7FFFFFFF);
+    if (arena.xkey.path[i] & 0x80000000) arena.xkey.path_str[pos++] = '\'';
+  }
+  arena.xkey.path_str[pos] = 0;
 
-  /* display the account address */
+  /* display the path */
   clear_screens();
-  add_screens("Account", recipient_address, strlen(recipient_address), false);
+  add_screens("Path", arena.xkey.path_str, pos, false);
+
+  /* the path on the arena waits for the approval */
+  stream_part(INS_GET_EXTENDED_KEY, true);
 
   is_signing = false;
   is_first_part = true;
@@ -0,0 +1,70 @@
+////////////////////////////////////////////////////////////////////////////////
+// SETTINGS
+////////////////////////////////////////////////////////////////////////////////
+
+// The settings are stored on the key-value store of the flash memory (NVM),
+// so they are kept when the app is closed. A copy is kept on RAM, read from
+// the store on the app start. They are changed only by the user, on the
+// device.
+
+// Options for the number of pages displayed from long payloads
+#define PAGE_LIMIT_4    0   // default
+#define PAGE_LIMIT_8    1
+#define PAGE_LIMIT_16   2
+#define PAGE_LIMIT_ALL  3
+
+// Keys of the settings on the key-value store
+#define KV_PREHASHED_DEPLOY   0x0001
+#define KV_PAGE_LIMIT         0x0002
+#define KV_BINARY_AS_HEX      0x0003
+
+struct settings {
+  uint8_t prehashed_deploy;   // accept contract deployments with the payload hash
+  uint8_t page_limit;         // pages displayed from long payloads
+  uint8_t binary_as_hex;      // display binary payloads in hex
+};
+
+static struct settings settings;
+
+static uint8_t settings_load(uint16_t key, uint8_t default_value) {
+  uint8_t value;
+
+  if (kv_get(key, &value, sizeof(value)) != sizeof(value)) {
+    return default_value;
+  }
+  return value;
+}
+
+// call after kv_init()
+static void settings_init() {
+  settings.prehashed_deploy = settings_load(KV_PREHASHED_DEPLOY, 0);
+  settings.page_limit = settings_load(KV_PAGE_LIMIT, PAGE_LIMIT_4);
+  settings.binary_as_hex = settings_load(KV_BINARY_AS_HEX, 0);
+}
+
+static void settings_store(uint16_t key, uint8_t *field, uint8_t value) {
+  kv_put(key, &value, sizeof(value));
+  *field = value;
+}
+
+static inline void settings_set_prehashed_deploy(bool enabled) {
+  settings_store(KV_PREHASHED_DEPLOY, &settings.prehashed_deploy, enabled ? 1 : 0);
+}
+
+static inline void settings_set_page_limit(uint8_t option) {
+  settings_store(KV_PAGE_LIMIT, &settings.page_limit, option);
+}
+
+static inline void settings_set_binary_as_hex(bool enabled) {
+  settings_store(KV_BINARY_AS_HEX, &settings.binary_as_hex, enabled ? 1 : 0);
+}
+
+// the maximum number of pages displayed from a long payload, 0 = no limit
+static int settings_max_pages() {
+  switch (settings.page_limit) {
+  case PAGE_LIMIT_8:   return 8;
+  case PAGE_LIMIT_16:  return 16;
+  case PAGE_LIMIT_ALL: return 0;
+  default:             return 4;
+  }
+}
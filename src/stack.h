@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+// STACK USAGE
+////////////////////////////////////////////////////////////////////////////////
+
+// Measures the peak stack usage (high-water mark) of each command. The free
+// part of the stack is filled with a pattern ("painted") and the deepest word
+// that no longer has it gives the peak usage.
+// The stack is painted again when each APDU arrives, and the peak is stored
+// for the previous command. So the usage of a command includes the UI
+// events processed until the next APDU, like the user approval and the
+// signature of a transaction.
+// It is only compiled on builds with HAVE_STACK_USAGE (make STACK_USAGE=1)
+// and is read with the GET_STACK_USAGE instruction. On other builds the
+// macros do nothing.
+
+#define STACK_PATTERN       0xA5A5A5A5
+#define STACK_MARGIN        64    // bytes not painted below the current frame
+#define STACK_MAX_INS       16    // peaks stored per INS, the others on the slot 0
+#define STACK_TXN_TYPES     8     // peaks of SIGN_TXN per transaction type
+
+#ifdef HAVE_STACK_USAGE
+
+// the stack region, from the linker script. the host tests use a simulated one
+#ifndef STACK_BOTTOM
+extern unsigned int app_stack_canary;
+extern unsigned int _estack;
+#define STACK_BOTTOM      (&app_stack_canary + 1)   // the canary is kept
+#define STACK_TOP         (&_estack)
+// the painting stops below the frame of the caller
+#define stack_paint_end(frame)  ((unsigned int *)(frame) - STACK_MARGIN / 4)
+#endif
+
+struct stack_usage {
+  uint16_t per_ins[STACK_MAX_INS];
+  uint16_t per_txn_type[STACK_TXN_TYPES];
+  uint16_t peak;                      // since the app start or the reset
+};
+
+static struct stack_usage stack_usage;
+static uint8_t stack_ins;             // command being measured
+static bool stack_is_txn;             // it is SIGN_TXN
+
+static void stack_paint() {
+  volatile unsigned int frame;
+  unsigned int *ptr = STACK_BOTTOM;
+  unsigned int *end = stack_paint_end(&frame);
+
+  while (ptr < end) {
+    *ptr++ = STACK_PATTERN;
+  }
+}
+
+// bytes used on the deepest point since the last paint
+static unsigned int stack_high_water() {
+  unsigned int *ptr = STACK_BOTTOM;
+
+  while (ptr < STACK_TOP && *ptr == STACK_PATTERN) {
+    ptr++;
+  }
+  return (STACK_TOP - ptr) * sizeof(unsigned int);
+}
+
+static void stack_store_peak(uint16_t *slot, unsigned int used) {
+  if (used > *slot) *slot = used;
+}
+
+/*
+** Called when an APDU arrives. Stores the peak of the previous command,
+** with the type of its transaction, and paints the stack for the new one.
+*/
+static void stack_command_start(unsigned char ins, bool is_txn, unsigned char txn_type) {
+  unsigned int used = stack_high_water();
+
+  stack_store_peak(&stack_usage.peak, used);
+  stack_store_peak(&stack_usage.per_ins[stack_ins], used);
+  if (stack_is_txn && txn_type < STACK_TXN_TYPES) {
+    stack_store_peak(&stack_usage.per_txn_type[txn_type], used);
+  }
+
+  stack_ins = ins < STACK_MAX_INS ? ins : 0;
+  stack_is_txn = is_txn;
+  stack_paint();
+}
+
+static void stack_reset() {
+  memset(&stack_usage, 0, sizeof(stack_usage));
+  stack_ins = 0;
+  stack_is_txn = false;
+  stack_paint();
+}
+
+static void stack_write_uint16(unsigned char *out, unsigned int value) {
+  out[0] = value >> 8;
+  out[1] = value;
+}
+
+/*
+** Writes the stack size, the peak since the reset, the peak per INS and the
+** peak of SIGN_TXN per transaction type, in bytes, as 16-bit big-endian
+** integers. Returns the number of bytes written.
+*/
+static unsigned int get_stack_usage(unsigned char *out) {
+  unsigned int pos, i;
+
+  stack_write_uint16(out, (STACK_TOP - STACK_BOTTOM) * sizeof(unsigned int));
+  stack_write_uint16(out + 2, stack_usage.peak);
+  pos = 4;
+  for (i = 0; i < STACK_MAX_INS; i++) {
+    stack_write_uint16(out + pos, stack_usage.per_ins[i]);
+    pos += 2;
+  }
+  for (i = 0; i < STACK_TXN_TYPES; i++) {
+    stack_write_uint16(out + pos, stack_usage.per_txn_type[i]);
+    pos += 2;
+  }
+
+  return pos;
+}
+
+// used on the main loop, where the INS and the transaction type are defined
+#define STACK_COMMAND_START(ins)  stack_command_start(ins, (ins) == INS_SIGN_TXN, txn_type)
+
+#else
+
+#define STACK_COMMAND_START(ins)  ((void)0)
+#define stack_reset()
+
+#endif
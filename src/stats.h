@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+// PERFORMANCE COUNTERS
+////////////////////////////////////////////////////////////////////////////////
+
+// Counters of the work done by the app, to measure it on a real device.
+// They are only compiled on builds with HAVE_STATS (make STATS=1) and are
+// read with the GET_STATS instruction. On other builds the macros do nothing.
+// The cycle counts use the DWT cycle counter of the Cortex-M core, when the
+// build has HAVE_DWT_CYCCNT (make STATS_CYCLES=1, only on the Nano X and
+// Nano S Plus), otherwise they are zero.
+
+// Phases measured in cycles
+#define STATS_PARSE    0
+#define STATS_RENDER   1
+#define STATS_DERIVE   2
+#define STATS_SIGN     3
+#define STATS_PHASES   4
+
+#define STATS_MAX_INS  16   // APDUs counted per INS, the others on the slot 0
+
+// the DWT cycle counter, also used by the event trace. The Nano S core
+// (SC000) has no DWT unit. The registers are on the private peripheral
+// bus, so the app must be allowed to access them, as on development
+// firmwares: on other firmwares the access faults
+#ifdef HAVE_DWT_CYCCNT
+#if !defined(TARGET_NANOX) && !defined(TARGET_NANOS2)
+#error "HAVE_DWT_CYCCNT is only supported on the Nano X and Nano S Plus"
+#endif
+#define DWT_CTRL    (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT  (*(volatile uint32_t *)0xE0001004)
+#define DEMCR       (*(volatile uint32_t *)0xE000EDFC)
+
+static uint32_t read_cycle_counter() {
+  return DWT_CYCCNT;
+}
+
+static void start_cycle_counter() {
+  DEMCR |= (1 << 24);   // TRCENA
+  DWT_CTRL |= 1;        // CYCCNTENA
+}
+#else
+#define read_cycle_counter() 0
+#define start_cycle_counter()
+#endif
+
+#ifdef HAVE_STATS
+
+struct stats {
+  uint32_t apdus[STATS_MAX_INS];      // APDUs received per INS
+  uint32_t parts;                     // transaction parts parsed
+  uint32_t restreams;                 // first part requested again
+  uint32_t hashed_bytes;
+  uint32_t hash_calls;                // calls to cx_hash
+  uint32_t pages;                     // pages rendered
+  uint32_t derivations;               // BIP32 key derivations
+  uint64_t cycles[STATS_PHASES];
+};
+
+static struct stats stats;
+
+static void stats_reset() {
+  memset(&stats, 0, sizeof(stats));
+  start_cycle_counter();
+}
+
+static void stats_count_apdu(unsigned int ins) {
+  stats.apdus[ins < STATS_MAX_INS ? ins : 0]++;
+}
+
+#define STATS_INC(field)        (stats.field++)
+#define STATS_ADD(field, n)     (stats.field += (n))
+#define STATS_APDU(ins)         stats_count_apdu(ins)
+#define STATS_HASH(len)         (stats.hash_calls++, stats.hashed_bytes += (len))
+// measures the cycles from STATS_BEGIN() to STATS_END(phase), on the same block
+#define STATS_BEGIN()           uint32_t stats_start = read_cycle_counter()
+#define STATS_END(phase)        (stats.cycles[phase] += (uint32_t)(read_cycle_counter() - stats_start))
+
+static void write_uint32_be(unsigned char *out, uint32_t value) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+/*
+** Writes the counters as big-endian integers: the APDUs per INS, the other
+** counters (4 bytes each) and the cycles of each phase (8 bytes each).
+** Returns the number of bytes written.
+*/
+static unsigned int get_stats(unsigned char *out) {
+  uint32_t counters[6];
+  unsigned int pos = 0, i;
+
+  counters[0] = stats.parts;
+  counters[1] = stats.restreams;
+  counters[2] = stats.hashed_bytes;
+  counters[3] = stats.hash_calls;
+  counters[4] = stats.pages;
+  counters[5] = stats.derivations;
+
+  for (i = 0; i < STATS_MAX_INS; i++) {
+    write_uint32_be(out + pos, stats.apdus[i]);
+    pos += 4;
+  }
+  for (i = 0; i < 6; i++) {
+    write_uint32_be(out + pos, counters[i]);
+    pos += 4;
+  }
+  for (i = 0; i < STATS_PHASES; i++) {
+    write_uint32_be(out + pos, stats.cycles[i] >> 32);
+    write_uint32_be(out + pos + 4, (uint32_t) stats.cycles[i]);
+    pos += 8;
+  }
+
+  return pos;
+}
+
+#else
+
+#define STATS_INC(field)        ((void)0)
+#define STATS_ADD(field, n)     ((void)0)
+#define STATS_APDU(ins)         ((void)0)
+#define STATS_HASH(len)         ((void)0)
+#define STATS_BEGIN()
+#define STATS_END(phase)        ((void)0)
+#define stats_reset()
+
+#endif
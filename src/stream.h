@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////////////
+// STREAM OF PARTS
+////////////////////////////////////////////////////////////////////////////////
+
+// The commands sent in many parts (SIGN_TXN, SIGN_MSG, SIGN_BATCH and
+// PARSE_TXN) keep their state on the arena and on txn_hash from the first
+// part until the user approves or rejects it. The command that owns this
+// state is stored on stream_ins, so the parts of one command cannot continue
+// the stream of another, and an approval only signs the hash of the command
+// being reviewed.
+// The commands that wait for the user approval of a buffer on the arena are
+// streams of a single part, so they own it the same way.
+// Any other command that writes on the arena ends the stream (on the main
+// loop), and with it the review.
+
+/*
+** Called on each part. The first part starts the stream of the command,
+** the others must continue it.
+*/
+static void stream_part(int ins, bool is_first) {
+  if (is_first) {
+    stream_ins = ins;
+  } else if (stream_ins != ins) {
+    THROW(SW_INVALID_STATE);
+  }
+}
+
+/*
+** Called by the commands that write on the buffers of the stream. A later
+** part of the stream is then rejected.
+*/
+static inline void reset_stream() {
+  stream_ins = 0;
+  txn_is_complete = false;
+}
+
+// commands that do not use the arena, answered during a review
+static inline bool is_read_only_command(int ins) {
+  return ins == INS_GET_APP_VERSION ||
+         ins == INS_GET_STATS ||
+         ins == INS_GET_TRACE ||
+         ins == INS_GET_STACK_USAGE;
+}
+
+/*
+** Called on the main loop for each command. Returns true if it ends the
+** stream of another command, and with it the review.
+*/
+static inline bool stream_is_ended_by(int ins) {
+  return stream_ins != 0 && ins != stream_ins && !is_read_only_command(ins);
+}
+
+/*
+** Called when the user approves a review. The state on the arena must still
+** be the one of the command that displayed it.
+*/
+static inline void stream_approve(int ins) {
+  if (stream_ins != ins) {
+    THROW(SW_INVALID_STATE);
+  }
+  stream_ins = 0;
+}
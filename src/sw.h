@@ -36,7 +36,59 @@
  * Status word for invalid state.
  */
 #define SW_INVALID_STATE 0x6985
+/**
+ * Status word for command not allowed by the settings.
+ */
+#define SW_NOT_ALLOWED 0x6986
 /**
  * Status word for incomplete transaction.
  */
 #define SW_TXN_INCOMPLETE 0x6735
+/**
+ * Status word for batch with the maximum number of transactions.
+ */
+#define SW_BATCH_FULL 0x6736
+/**
+ * Status word for a transaction not accepted on a batch.
+ */
+#define SW_BATCH_INVALID_TXN 0x6737
+/**
+ * Status word for invalid compressed data.
+ */
+#define SW_INVALID_COMPRESSED 0x6738
+/**
+ * Status word for an invalid transaction envelope.
+ */
+#define SW_INVALID_ENVELOPE 0x6739
+/**
+ * Status word for a transaction that does not match the declared envelope.
+ */
+#define SW_ENVELOPE_MISMATCH 0x673A
+/**
+ * Status word for an invalid contract ABI.
+ */
+#define SW_INVALID_ABI 0x673B
+/**
+ * Status word for a full contract ABI registry.
+ */
+#define SW_ABI_REGISTRY_FULL 0x673C
+/**
+ * Status word for an invalid address book entry.
+ */
+#define SW_INVALID_LABEL 0x673D
+/**
+ * Status word for a full address book.
+ */
+#define SW_ADDRESS_BOOK_FULL 0x673E
+/**
+ * Status word for an invalid signing policy.
+ */
+#define SW_INVALID_POLICY 0x673F
+/**
+ * Status word for a full signing policy table.
+ */
+#define SW_POLICY_TABLE_FULL 0x6756
+/**
+ * Status word for a full key-value store.
+ */
+#define SW_STORAGE_FULL 0x6757
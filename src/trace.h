@@ -0,0 +1,160 @@
+////////////////////////////////////////////////////////////////////////////////
+// EVENT TRACE
+////////////////////////////////////////////////////////////////////////////////
+
+// A ring of timestamped events, to see on the host the timeline of the
+// exchanges with the device: the APDUs received and sent, the transaction
+// parts, the requests of parts and of pages, and the exceptions. When the
+// ring is full the oldest events are overwritten.
+// It is only compiled on builds with HAVE_TRACE (make TRACE=1) and is read
+// with the GET_TRACE instruction. On other builds the macros do nothing.
+// The timestamps are ticker events (100 ms each) or, on builds with
+// HAVE_DWT_CYCCNT (make TRACE_CYCLES=1), CPU cycles.
+
+// Event types
+#define TRACE_EV_APDU_IN       1   // a = INS, b = P1 << 8 | Lc
+#define TRACE_EV_APDU_OUT      2   // a = response length, b = status word
+#define TRACE_EV_PART          3   // a = TRACE_FIRST | TRACE_LAST | TRACE_COMPLETE, b = part length
+#define TRACE_EV_PART_REQUEST  4   // a = 1 for the first part, 0 for the next, b = status word
+#define TRACE_EV_PAGE          5   // a = PAGE_FIRST/NEXT/PREV/LAST, b = page to display
+#define TRACE_EV_EXCEPTION     6   // b = exception caught on the main loop
+
+// Flags of the TRACE_EV_PART events
+#define TRACE_FIRST     0x01
+#define TRACE_LAST      0x02
+#define TRACE_COMPLETE  0x04
+
+// Unit of the timestamps
+#define TRACE_CLOCK_TICKS   0
+#define TRACE_CLOCK_CYCLES  1
+
+#define TRACE_HEADER_SIZE     8
+#define TRACE_EVENT_SIZE      8
+#define TRACE_MAX_PER_READ    30   // events per response
+
+#ifdef HAVE_TRACE
+
+#ifdef TARGET_NANOS
+#define TRACE_SIZE  32
+#else
+#define TRACE_SIZE  128
+#endif
+
+struct trace_event {
+  uint32_t time;
+  uint8_t  type;
+  uint8_t  a;
+  uint16_t b;
+};
+
+static struct trace_event trace_ring[TRACE_SIZE];
+static uint32_t trace_total;          // events recorded, including the overwritten
+static uint32_t trace_ticks;
+static bool trace_paused;             // while the trace is being read
+
+#ifdef HAVE_DWT_CYCCNT
+#define TRACE_CLOCK      TRACE_CLOCK_CYCLES
+#define trace_clock()    read_cycle_counter()
+#else
+#define TRACE_CLOCK      TRACE_CLOCK_TICKS
+#define trace_clock()    trace_ticks
+#endif
+
+static void trace_reset() {
+  memset(trace_ring, 0, sizeof(trace_ring));
+  trace_total = 0;
+  start_cycle_counter();
+}
+
+static void trace_add(uint8_t type, uint8_t a, uint16_t b) {
+  struct trace_event *event;
+
+  if (trace_paused) return;
+
+  event = &trace_ring[trace_total % TRACE_SIZE];
+  event->time = trace_clock();
+  event->type = type;
+  event->a = a;
+  event->b = b;
+  trace_total++;
+}
+
+/*
+** The reads of the trace are not recorded, so it does not change while the
+** host reads it in many APDUs.
+*/
+static void trace_apdu_in(unsigned char *buf, bool is_trace_read) {
+  trace_paused = is_trace_read;
+  trace_add(TRACE_EV_APDU_IN, buf[1], (buf[2] << 8) | buf[4]);
+}
+
+// the response is on the APDU buffer, ending with the status word
+static void trace_apdu_out(unsigned char *buf, unsigned int tx) {
+  trace_add(TRACE_EV_APDU_OUT, tx - 2 > 255 ? 255 : tx - 2, (buf[tx - 2] << 8) | buf[tx - 1]);
+}
+
+static void trace_write_be(unsigned char *out, uint32_t value, unsigned int len) {
+  while (len > 0) {
+    out[--len] = value;
+    value >>= 8;
+  }
+}
+
+/*
+** Writes a header and the events, from the given one (0 = the oldest on
+** the ring), as many as fit on a response. After the last one there are no
+** events. All integers are big-endian:
+**   clock unit (1) | number of events on the response (1) |
+**   events on the ring (2) | events recorded since the reset (4) |
+**   events: timestamp (4) | type (1) | a (1) | b (2)
+** Returns the number of bytes written.
+*/
+static unsigned int get_trace(unsigned char *out, unsigned int first) {
+  unsigned int count, oldest, num, pos, i;
+
+  count = trace_total < TRACE_SIZE ? trace_total : TRACE_SIZE;
+  oldest = trace_total - count;
+
+  if (first > count) first = count;
+  num = count - first;
+  if (num > TRACE_MAX_PER_READ) num = TRACE_MAX_PER_READ;
+
+  out[0] = TRACE_CLOCK;
+  out[1] = num;
+  trace_write_be(out + 2, count, 2);
+  trace_write_be(out + 4, trace_total, 4);
+  pos = TRACE_HEADER_SIZE;
+
+  for (i = 0; i < num; i++) {
+    struct trace_event *event = &trace_ring[(oldest + first + i) % TRACE_SIZE];
+    trace_write_be(out + pos, event->time, 4);
+    out[pos + 4] = event->type;
+    out[pos + 5] = event->a;
+    trace_write_be(out + pos + 6, event->b, 2);
+    pos += TRACE_EVENT_SIZE;
+  }
+
+  return pos;
+}
+
+#define TRACE_TICK()                  (trace_ticks++)
+// used on the main loop, where the INS is defined
+#define TRACE_APDU_IN(buf)            trace_apdu_in(buf, (buf)[1] == INS_GET_TRACE)
+#define TRACE_APDU_OUT(buf, tx)       trace_apdu_out(buf, tx)
+#define TRACE_PART(flags, len)        trace_add(TRACE_EV_PART, flags, len)
+#define TRACE_PART_REQUEST(first, sw) trace_add(TRACE_EV_PART_REQUEST, first, sw)
+#define TRACE_PAGE(move, page)        trace_add(TRACE_EV_PAGE, move, page)
+#define TRACE_EXCEPTION(e)            trace_add(TRACE_EV_EXCEPTION, 0, e)
+
+#else
+
+#define TRACE_TICK()                  ((void)0)
+#define TRACE_APDU_IN(buf)            ((void)0)
+#define TRACE_APDU_OUT(buf, tx)       ((void)0)
+#define TRACE_PART(flags, len)        ((void)0)
+#define TRACE_PART_REQUEST(first, sw) ((void)0)
+#define TRACE_PAGE(move, page)        ((void)0)
+#define TRACE_EXCEPTION(e)            ((void)0)
+#define trace_reset()
+
+#endif
@@ -21,13 +21,16 @@ struct txn {
   uint64_t nonce;
   unsigned char *account;       // public key - 33 bytes
   unsigned char *recipient;     // public key - 33 bytes
+  unsigned int   recipient_len;
   unsigned char *amount;        // variable-length big integer
+  unsigned int   amount_len;
            char *payload;
   unsigned int   payload_len;
   unsigned int   payload_part_offset;
   unsigned int   payload_part_len;
   uint64_t gasLimit;
   unsigned char *gasPrice;      // variable-length big integer
+  unsigned int   gas_price_len;
   uint32_t type;
   unsigned char *chainId;       // hash value of chain identifier - 32 bytes
   bool is_name;
@@ -37,13 +40,16 @@ struct txn {
 
 struct txn txn;
 
-char recipient_address[EncodedAddressLength+1]; // encoded account address
+unsigned char txn_type;
 
-char amount_str[48];
+// the payload field carries the payload hash instead of the payload
+bool payload_is_prehashed;
 
-unsigned char txn_type;
+// where the gas price is copied when it is parsed, or NULL. It can be on
+// the buffer of the last fields, that is overwritten when a next field
+// is incomplete
+unsigned char *gas_price_copy;
 
-char last_part[128];
 int last_part_len;
 int last_part_pos;
 
@@ -85,8 +91,8 @@ static char * stripstr(char *mainstr, char *separator) {
 }
 */
 
-#define tx_hash_add(ptr,len) sha256_add(hash,ptr,len)
-#define payload_hash_add(ptr,len) sha256_add(hash2,ptr,len)
+#define tx_hash_add(ptr,len) sha256_add(arena.txn.hash,ptr,len)
+#define payload_hash_add(ptr,len) sha256_add(arena.txn.hash2,ptr,len)
 
 static bool parse_payload_part(unsigned char *ptr, unsigned int len);
 static bool parse_last_part(unsigned char *ptr, unsigned int len);
@@ -105,9 +111,9 @@ static bool parse_first_part(unsigned char *ptr, unsigned int len){
 
   // initialize hash
   memset(txn_hash, 0, sizeof txn_hash);
-  memset(payload_hash, 0, sizeof payload_hash);
-  sha256_init(hash);
-  sha256_init(hash2);
+  memset(arena.txn.payload_hash, 0, sizeof arena.txn.payload_hash);
+  sha256_init(arena.txn.hash);
+  sha256_init(arena.txn.hash2);
 
   // transaction type
   if (len < 1) goto loc_incomplete;
@@ -166,19 +172,20 @@ static bool parse_first_part(unsigned char *ptr, unsigned int len){
       }
     }
     txn.recipient = ptr;
+    txn.recipient_len = str_len;
     ptr += str_len;
     len -= str_len;
 
     tx_hash_add(txn.recipient, str_len);
 
     if (str_len == 33) {
-      encode_account(txn.recipient, str_len, recipient_address, sizeof recipient_address);
+      encode_account(txn.recipient, str_len, arena.txn.recipient_address, sizeof arena.txn.recipient_address);
     } else {
-      memmove(recipient_address, txn.recipient, str_len);
-      recipient_address[str_len] = 0;
+      memmove(arena.txn.recipient_address, txn.recipient, str_len);
+      arena.txn.recipient_address[str_len] = 0;
     }
   } else {
-    recipient_address[0] = 0;
+    arena.txn.recipient_address[0] = 0;
   }
 
   pos = 4;
@@ -200,15 +207,30 @@ static bool parse_first_part(unsigned char *ptr, unsigned int len){
     str_len = 1;
   }
 
+  txn.amount_len = str_len;
+
   tx_hash_add(txn.amount, str_len);
 
-  encode_amount(txn.amount, str_len, amount_str, sizeof amount_str);
+  encode_amount(txn.amount, str_len, arena.txn.amount_str, sizeof arena.txn.amount_str);
 
   pos = 5;
 
   // payload
   if (len < 1) goto loc_incomplete;
-  if (*ptr == 0x2A) {
+  if (*ptr == 0x2A && payload_is_prehashed) {
+    ptr++; len--;
+    size = decode_varint(ptr, len, &str_len);
+    if (size == 0 || len - size < str_len) goto loc_incomplete2;
+    ptr += size;
+    len -= size;
+    if (str_len != 32) goto loc_invalid;
+    if (txn_type != TXN_DEPLOY && txn_type != TXN_REDEPLOY) goto loc_invalid;
+    memcpy(arena.txn.payload_hash, ptr, 32);
+    ptr += 32;
+    len -= 32;
+
+    tx_hash_add(arena.txn.payload_hash, 32);
+  } else if (*ptr == 0x2A) {
     ptr++; len--;
     size = decode_varint(ptr, len, &str_len);
     if (size == 0) goto loc_incomplete2;
@@ -283,15 +305,15 @@ static bool parse_last_part(unsigned char *ptr, unsigned int len){
   uint64_t str_len, val64;
   unsigned int pos;
 
-  if (last_part_len + len > sizeof(last_part)) {
+  if (last_part_len + len > sizeof(arena.txn.last_part)) {
     THROW(0x6720 + 10);
   }
 
   if (last_part_pos == 0) {
     last_part_pos = 6;
   } else {
-    memcpy(last_part+last_part_len, ptr, len);
-    ptr = (unsigned char*) last_part;
+    memcpy(arena.txn.last_part+last_part_len, ptr, len);
+    ptr = (unsigned char*) arena.txn.last_part;
     len += last_part_len;
   }
 
@@ -334,8 +356,14 @@ static bool parse_last_part(unsigned char *ptr, unsigned int len){
     str_len = 1;
   }
 
+  txn.gas_price_len = str_len;
+
   tx_hash_add(txn.gasPrice, str_len);
 
+  if (gas_price_copy) {
+    memcpy(gas_price_copy, txn.gasPrice, str_len);
+  }
+
   case 8:
   pos = 8;
 
@@ -379,7 +407,7 @@ static bool parse_last_part(unsigned char *ptr, unsigned int len){
   txn_is_complete = true;
 
   /* calculate the transaction hash */
-  sha256_finish(hash, txn_hash);
+  sha256_finish(arena.txn.hash, txn_hash);
 
   return true;
 
@@ -388,7 +416,7 @@ loc_incomplete2:
   len++;
 loc_incomplete:
   /* incomplete transaction */
-  memcpy(last_part, ptr, len);
+  memcpy(arena.txn.last_part, ptr, len);
   last_part_len = len;
   last_part_pos = pos;
   return false;
@@ -481,6 +509,7 @@ void get_payload_info(unsigned char **ppayload, unsigned int *ppayload_len,
 }
 
 static void parse_transaction_part(unsigned char *buf, unsigned int len, bool is_first, bool is_last){
+  STATS_BEGIN();
 
   /* check the minimum transaction size */
   if (is_first && len < 60) {
@@ -506,4 +535,8 @@ static void parse_transaction_part(unsigned char *buf, unsigned int len, bool is
     THROW(SW_TXN_INCOMPLETE);
   }
 
+  STATS_INC(parts);
+  STATS_END(STATS_PARSE);
+  TRACE_PART((is_first ? TRACE_FIRST : 0) | (is_last ? TRACE_LAST : 0) |
+             (txn_is_complete ? TRACE_COMPLETE : 0), len);
 }
@@ -1,10 +1,11 @@
 import struct
-from typing import Tuple
+from typing import Dict, List, Tuple
 
 from speculos.client import SpeculosClient, ApduResponse, ApduException
 
 from app_client.app_cmd_builder import AppCommandBuilder, InsType
 from app_client.exception import DeviceException
+from app_client.trace import TraceEvent, decode_trace
 
 
 class AppCommand:
@@ -90,6 +91,98 @@ class AppCommand:
         return response
 
 
+    def get_trace(self, reset: bool = False) -> Tuple[int, List[TraceEvent]]:
+        """Read all the events of the trace (builds made with TRACE=1).
+
+        Returns the clock unit of the timestamps and the events, from the
+        oldest to the newest.
+        """
+        responses: List[bytes] = []
+        count: int = 1
+        read: int = 0
+
+        while read < count:
+            try:
+                response = self.client._apdu_exchange(
+                    self.builder.get_trace(first=read)
+                )  # type: int, bytes
+            except ApduException as error:
+                raise DeviceException(error_code=error.sw, ins=InsType.INS_GET_TRACE)
+            count = int.from_bytes(response[2:4], byteorder="big")
+            if response[1] == 0:
+                break
+            read += response[1]
+            responses.append(response)
+
+        if reset:
+            self.client._apdu_exchange(self.builder.get_trace(first=count, reset=True))
+
+        return decode_trace(responses)
+
+
+    def get_stack_usage(self, reset: bool = False) -> Dict[str, int]:
+        """Read the peak stack usage, in bytes (builds made with STACK_USAGE=1).
+
+        The usage of a command is only known when the next APDU arrives, so
+        this reports the commands sent before it. Returns the stack size, the
+        overall peak, the peak of each instruction used and the peak of
+        SIGN_TX per transaction type.
+        """
+        try:
+            response = self.client._apdu_exchange(
+                self.builder.get_stack_usage(reset=reset)
+            )  # type: int, bytes
+        except ApduException as error:
+            raise DeviceException(error_code=error.sw, ins=InsType.INS_GET_STACK_USAGE)
+
+        # response = size (2) || peak (2) || peak per INS (16 * 2) ||
+        #            peak of SIGN_TX per transaction type (8 * 2)
+        assert len(response) == 4 + 16 * 2 + 8 * 2
+        values = struct.unpack(">2H16H8H", response)
+
+        usage: Dict[str, int] = {"size": values[0], "peak": values[1]}
+        for ins in InsType:
+            if ins.value < 16 and values[2 + ins.value] > 0:
+                usage[ins.name] = values[2 + ins.value]
+        txn_types = ["NORMAL", "GOVERNANCE", "REDEPLOY", "FEEDELEGATION",
+                     "TRANSFER", "CALL", "DEPLOY", "MULTICALL"]
+        for i, name in enumerate(txn_types):
+            if values[18 + i] > 0:
+                usage[f"INS_SIGN_TX {name}"] = values[18 + i]
+
+        return usage
+
+
+    def get_screen(self) -> Tuple[int, int, str, str]:
+        """Read what is on the screen (builds made with DEBUG=1).
+
+        Returns the current page, the number of screens, the title and the
+        text. It can be sent while a command waits for the user; the
+        response of that command comes later.
+        """
+        try:
+            response = self.client._apdu_exchange(
+                self.builder.get_screen()
+            )  # type: int, bytes
+        except ApduException as error:
+            raise DeviceException(error_code=error.sw, ins=InsType.INS_GET_SCREEN)
+
+        # response = page (2) || screens (2) ||
+        #            title_len (1) || title (var) ||
+        #            text_len (1) || text (var)
+        page, screens = struct.unpack(">HH", response[:4])
+        offset: int = 4
+        title_len: int = response[offset]
+        offset += 1
+        title: str = response[offset:offset + title_len].decode("ascii")
+        offset += title_len
+        text_len: int = response[offset]
+        offset += 1
+        text: str = response[offset:offset + text_len].decode("ascii")
+
+        return page, screens, title, text
+
+
     def sign_tx(self, transaction: bytes, model: str) -> Tuple[int, bytes]:
         sw: int
         response: bytes = b""
@@ -135,13 +228,13 @@ class AppCommand:
             print("text :", event["text"])
             print("-------------------")
 
-        # Recipient
-        self.client.press_and_release('right')
-        event = self.client.get_next_event()
-        print("text :", event["text"])
-        event = self.client.get_next_event()
-        print("text :", event["text"])
-        print("-------------------")
+            # Recipient
+            self.client.press_and_release('right')
+            event = self.client.get_next_event()
+            print("text :", event["text"])
+            event = self.client.get_next_event()
+            print("text :", event["text"])
+            print("-------------------")
 
         # Recipient
         self.client.press_and_release('right')
@@ -32,12 +32,29 @@ class InsType(enum.IntEnum):
     INS_GET_PUBLIC_KEY = 0x02
     INS_DISPLAY_ACCOUNT = 0x03
     INS_SIGN_TX = 0x04
+    INS_SIGN_BATCH = 0x05
+    INS_GET_PUBLIC_KEYS = 0x06
+    INS_GET_EXTENDED_KEY = 0x07
     INS_SIGN_MSG = 0x08
+    INS_PARSE_TX = 0x09
+    INS_DECLARE_TX = 0x0A
+    INS_REGISTER_ABI = 0x0B
+    INS_ADD_ADDRESS = 0x0C
+    INS_ADD_POLICY = 0x0D
+    INS_GET_STATS = 0x0E
+    INS_GET_TRACE = 0x0F
+    INS_GET_STACK_USAGE = 0x10
+    INS_GET_SCREEN = 0x11
 
 
 P1_FIRST: int = 0x01
 P1_LAST : int = 0x02
+P1_PATH : int = 0x04
 P1_HEX  : int = 0x08
+P1_PREHASHED: int = 0x20
+P1_COMPRESSED: int = 0x40
+P1_SIGNATURES: int = 0x10
+P1_RESET: int = 0x01
 
 
 class AppCommandBuilder:
@@ -196,3 +213,63 @@ class AppCommandBuilder:
             chunks.append(data)
 
         return chunks
+
+
+    def get_trace(self, first: int = 0, reset: bool = False) -> bytes:
+        """Command builder for GET_TRACE.
+
+        Parameters
+        ----------
+        first : int
+            Index of the first event to read, 0 is the oldest one.
+        reset : bool
+            Whether the trace is cleared after this read.
+
+        Returns
+        -------
+        bytes
+            APDU command for GET_TRACE.
+
+        """
+        return self.serialize(cla=self.CLA,
+                              ins=InsType.INS_GET_TRACE,
+                              p1=P1_RESET if reset else 0x00,
+                              p2=first,
+                              cdata=b"")
+
+
+    def get_stack_usage(self, reset: bool = False) -> bytes:
+        """Command builder for GET_STACK_USAGE.
+
+        Parameters
+        ----------
+        reset : bool
+            Whether the peaks are cleared after this read.
+
+        Returns
+        -------
+        bytes
+            APDU command for GET_STACK_USAGE.
+
+        """
+        return self.serialize(cla=self.CLA,
+                              ins=InsType.INS_GET_STACK_USAGE,
+                              p1=P1_RESET if reset else 0x00,
+                              p2=0x00,
+                              cdata=b"")
+
+
+    def get_screen(self) -> bytes:
+        """Command builder for GET_SCREEN (debug builds).
+
+        Returns
+        -------
+        bytes
+            APDU command for GET_SCREEN.
+
+        """
+        return self.serialize(cla=self.CLA,
+                              ins=InsType.INS_GET_SCREEN,
+                              p1=0x00,
+                              p2=0x00,
+                              cdata=b"")
@@ -0,0 +1,110 @@
+"""Decoder of the event trace returned by the GET_TRACE instruction.
+
+The events are shown as a timeline, with the time since the previous event.
+The exchanges where the host took long to send the next APDU (round trips)
+are marked, to find the navigation sequences that cause stalls.
+
+Usage, with the GET_TRACE responses in hex, one per line:
+
+    python -m app_client.trace < responses.txt
+"""
+
+import sys
+from dataclasses import dataclass
+from typing import List, Tuple
+
+HEADER_SIZE: int = 8
+EVENT_SIZE: int = 8
+
+CLOCK_TICKS: int = 0    # ticker events, 100 ms each
+CLOCK_CYCLES: int = 1   # CPU cycles
+
+EV_APDU_IN: int = 1
+EV_APDU_OUT: int = 2
+EV_PART: int = 3
+EV_PART_REQUEST: int = 4
+EV_PAGE: int = 5
+EV_EXCEPTION: int = 6
+
+PAGE_MOVES = {1: "first", 2: "next", 3: "prev", 4: "last"}
+
+# events after which the device waits for the host
+REPLIES = (EV_APDU_OUT, EV_PART_REQUEST)
+
+
+@dataclass
+class TraceEvent:
+    time: int
+    type: int
+    a: int
+    b: int
+
+    def describe(self) -> str:
+        if self.type == EV_APDU_IN:
+            return f"-> APDU INS={self.a:02X} P1={self.b >> 8:02X} Lc={self.b & 0xFF}"
+        if self.type == EV_APDU_OUT:
+            return f"<- {self.b:04X} ({self.a} bytes)"
+        if self.type == EV_PART:
+            flags = [name for bit, name in ((1, "first"), (2, "last"), (4, "complete"))
+                     if self.a & bit]
+            return " ".join([f"   part of {self.b} bytes", *flags])
+        if self.type == EV_PART_REQUEST:
+            return f"<- {self.b:04X} request the {'first' if self.a else 'next'} part"
+        if self.type == EV_PAGE:
+            page = "last" if self.b == 0xFFFF else self.b
+            return f"   page {PAGE_MOVES.get(self.a, self.a)}: {page}"
+        if self.type == EV_EXCEPTION:
+            return f"   exception {self.b:04X}"
+        return f"   unknown event {self.type}"
+
+
+def decode_trace(responses: List[bytes]) -> Tuple[int, List[TraceEvent]]:
+    """Decode the GET_TRACE responses, read in sequence from the first event.
+
+    Returns the clock unit of the timestamps and the events.
+    """
+    clock: int = CLOCK_TICKS
+    events: List[TraceEvent] = []
+
+    for response in responses:
+        clock = response[0]
+        num: int = response[1]
+        for i in range(num):
+            offset = HEADER_SIZE + i * EVENT_SIZE
+            record = response[offset:offset + EVENT_SIZE]
+            events.append(TraceEvent(time=int.from_bytes(record[0:4], byteorder="big"),
+                                     type=record[4],
+                                     a=record[5],
+                                     b=int.from_bytes(record[6:8], byteorder="big")))
+
+    return clock, events
+
+
+def format_timeline(clock: int, events: List[TraceEvent], stall: int = 0) -> str:
+    """Format the events as a timeline.
+
+    The round trips to the host longer than `stall` (in the clock unit) are
+    marked. The default is 5 ticks (500 ms) or 1M cycles.
+    """
+    if stall == 0:
+        stall = 5 if clock == CLOCK_TICKS else 1000000
+    unit: str = "ticks" if clock == CLOCK_TICKS else "cycles"
+    lines: List[str] = []
+    previous = None
+
+    for event in events:
+        # the 32-bit cycle counter wraps around
+        delta: int = (event.time - previous.time) & 0xFFFFFFFF if previous else 0
+        mark: str = ""
+        if previous and previous.type in REPLIES and event.type == EV_APDU_IN \
+           and delta >= stall:
+            mark = "  <== host round trip"
+        lines.append(f"{event.time:>10} {unit} +{delta:<8} {event.describe()}{mark}")
+        previous = event
+
+    return "\n".join(lines)
+
+
+if __name__ == "__main__":
+    dumps = [bytes.fromhex(line.strip()) for line in sys.stdin if line.strip()]
+    print(format_timeline(*decode_trace(dumps)))
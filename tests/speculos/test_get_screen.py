@@ -0,0 +1,53 @@
+import pytest
+
+from speculos.client import ApduResponse, ApduException
+
+from app_client.exception import InsNotSupportedError
+
+
+TRANSFER = b"\x04\x08\x0a\x12\x21\x02\x9d\x02\x05\x91\xe7\xfb\x7b\x09\x21\x53\x68\x19\x95\xf8\x06\x09\xf0\xac\x98\x8a\x4d\x93\x5e\x0e\xa6\x3c\x06\x0f\x19\x54\xb0\x5f\x1a\x21\x03\x8c\xb9\x2c\xde\xbf\x39\x98\x69\x09\x3c\xac\x47\xe3\x70\xd8\xa9\xfa\x50\x17\x30\x42\x23\xf9\xad\x1a\x8c\x0a\x05\xa9\x06\xa9\xcb\x22\x08\x14\xd1\x12\x0d\x7b\x16\x00\x00\x3a\x01\x00\x40\x04\x4a\x20\x52\x48\x45\xc2\x4c\xd3\xe5\x3a\xec\xbc\xda\x8e\x31\x5d\x62\xdc\x95\xa7\xf2\xf8\x25\x48\x93\x0b\xc2\xfc\xc9\x86\xbf\x74\x53\xbd"
+
+
+def wait_screen(client, events: int):
+    # the events of the new step, so it is on the screen
+    for _ in range(events):
+        client.get_next_event()
+
+
+def test_get_screen_transfer(cmd, client):
+    # only on builds made with DEBUG=1
+    try:
+        cmd.get_screen()
+    except InsNotSupportedError:
+        pytest.skip("the app was built without DEBUG=1")
+
+    cmd.get_public_key(bip32_path="m/44'/441'/0'/0/0", display=False)
+
+    # a simple transfer is shown with the static steps
+    chunks = cmd.builder.get_sign_tx_commands(transaction=TRANSFER)
+    client_response = client._apdu_exchange_nowait(chunks[0])
+
+    wait_screen(client, 2)
+    _, _, title, text = cmd.get_screen()
+    assert (title, text) == ("Review", "Transaction")
+
+    client.press_and_release('right')
+    wait_screen(client, 2)
+    _, _, title, text = cmd.get_screen()
+    assert (title, text) == ("Amount", "1.5 AERGO")
+
+    # the flow loops from the first step to the last one
+    client.press_and_release('left')
+    wait_screen(client, 2)
+    client.press_and_release('left')
+    wait_screen(client, 1)
+    _, _, title, text = cmd.get_screen()
+    assert (title, text) == ("Reject", "")
+
+    client.press_and_release('both')
+    with pytest.raises(ApduException) as error:
+        ApduResponse(client_response).receive()
+    assert error.value.sw == 0x6982
+
+    _, _, title, text = cmd.get_screen()
+    assert (title, text) == ("", "")
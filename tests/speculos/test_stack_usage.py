@@ -0,0 +1,21 @@
+import pytest
+
+from app_client.exception import InsNotSupportedError
+
+
+def test_stack_usage(cmd):
+    # only on builds made with STACK_USAGE=1
+    try:
+        cmd.get_stack_usage(reset=True)
+    except InsNotSupportedError:
+        pytest.skip("the app was built without STACK_USAGE=1")
+
+    cmd.get_public_key(bip32_path="m/44'/441'/0'/0/0", display=False)
+    cmd.get_version()
+
+    usage = cmd.get_stack_usage()
+
+    for name, value in usage.items():
+        print(f"{name}: {value} bytes")
+
+    assert 0 < usage["INS_GET_PUBLIC_KEY"] <= usage["peak"] < usage["size"]
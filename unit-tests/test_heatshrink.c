@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "../src/common/heatshrink.h"
+
+static void test_heatshrink_literals(void **state) {
+    (void) state;
+    unsigned char out[16];
+
+    // 1 'A' 1 'B' + padding
+    const unsigned char in[] = { 0xA0, 0xD0, 0x80 };
+
+    assert_int_equal(heatshrink_decode(in, sizeof in, out, sizeof out), 2);
+    assert_memory_equal(out, "AB", 2);
+}
+
+static void test_heatshrink_overlapping_copy(void **state) {
+    (void) state;
+    unsigned char out[16];
+
+    // literal 'a', then copy 9 bytes from 1 byte back
+    const unsigned char in[] = { 0xB0, 0x80, 0x20 };
+
+    assert_int_equal(heatshrink_decode(in, sizeof in, out, sizeof out), 10);
+    assert_memory_equal(out, "aaaaaaaaaa", 10);
+}
+
+static void test_heatshrink_payload(void **state) {
+    (void) state;
+    unsigned char out[256];
+    const char *payload = "{\"Name\":\"transfer\",\"Args\":["
+        "\"AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp\","
+        "\"AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp\","
+        "\"1000000000000000000\"]}";
+
+    // clang-format off
+    const unsigned char in[] = {
+        0xbd, 0xc8, 0xa9, 0xd6, 0x1b, 0x6d, 0x96, 0x45, 0x3a, 0x91, 0x5d, 0x2e,
+        0x56, 0x1b, 0x75, 0xce, 0xcd, 0x65, 0xb9, 0x48, 0xa5, 0x92, 0x2a, 0x0d,
+        0xca, 0xcf, 0x73, 0x08, 0x8d, 0x6c, 0x0e, 0x36, 0xda, 0x85, 0x5e, 0xef,
+        0x6d, 0xb2, 0x59, 0xee, 0x17, 0x6a, 0x85, 0x4a, 0xa1, 0x74, 0xbc, 0xda,
+        0xec, 0xf4, 0x3a, 0x1d, 0x5e, 0xed, 0x56, 0xb2, 0x56, 0xaa, 0x73, 0x6b,
+        0x44, 0xde, 0xc5, 0x36, 0xbb, 0xce, 0x6a, 0xb7, 0xab, 0x1d, 0x32, 0xc7,
+        0x73, 0xa2, 0xd9, 0x26, 0xd3, 0x4b, 0x6d, 0xea, 0x97, 0x4a, 0x9c, 0xd4,
+        0xa8, 0x74, 0x1b, 0x45, 0xc0, 0x7c, 0x63, 0x6f, 0x1b, 0x78, 0xdb, 0xc6,
+        0xcb, 0x31, 0x98, 0x00, 0x3e, 0x61, 0x22, 0xae, 0xdf, 0x40,
+    };
+
+    assert_int_equal(heatshrink_decode(in, sizeof in, out, sizeof out), strlen(payload));
+    assert_memory_equal(out, payload, strlen(payload));
+
+    // it does not fit on the output
+    assert_int_equal(heatshrink_decode(in, sizeof in, out, 100), -1);
+}
+
+static void test_heatshrink_invalid_offset(void **state) {
+    (void) state;
+    unsigned char out[16];
+
+    // copy from 1 byte back, with an empty window
+    const unsigned char in[] = { 0x00, 0x08, 0x00 };
+
+    assert_int_equal(heatshrink_decode(in, sizeof in, out, sizeof out), -1);
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_heatshrink_literals),
+      cmocka_unit_test(test_heatshrink_overlapping_copy),
+      cmocka_unit_test(test_heatshrink_payload),
+      cmocka_unit_test(test_heatshrink_invalid_offset),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
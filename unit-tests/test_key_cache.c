@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "testing.h"
+#include "../src/globals.h"
+#include "../src/key_cache.h"
+
+
+static uint32_t path_of(int account, uint32_t *path) {
+  path[0] = 0x8000002C;
+  path[1] = 0x800001B9;
+  path[2] = 0x80000000 + account;
+  path[3] = 0;
+  path[4] = 0;
+  return 5;
+}
+
+static void add_account(int account) {
+  uint32_t path[MAX_BIP32_PATH];
+  unsigned char pubkey[33];
+  int len = path_of(account, path);
+  memset(pubkey, account, sizeof pubkey);
+  key_cache_add(path, len, pubkey);
+}
+
+static struct key_cache_entry * find_account(int account) {
+  uint32_t path[MAX_BIP32_PATH];
+  int len = path_of(account, path);
+  return key_cache_find(path, len);
+}
+
+static void test_key_cache_find(void **state) {
+    (void) state;
+    struct key_cache_entry *entry;
+    uint32_t path[MAX_BIP32_PATH];
+
+    key_cache_clear();
+    assert_null(find_account(1));
+
+    add_account(1);
+    add_account(2);
+
+    entry = find_account(1);
+    assert_non_null(entry);
+    assert_int_equal(entry->pubkey[0], 1);
+    assert_int_equal(entry->pubkey[32], 1);
+    assert_string_equal(entry->address, "");
+
+    entry = find_account(2);
+    assert_non_null(entry);
+    assert_int_equal(entry->pubkey[0], 2);
+
+    // a prefix of a cached path is a different path
+    path_of(1, path);
+    assert_null(key_cache_find(path, 4));
+
+    key_cache_clear();
+    assert_null(find_account(1));
+    assert_null(find_account(2));
+}
+
+static void test_key_cache_lru(void **state) {
+    (void) state;
+    int i;
+
+    key_cache_clear();
+
+    for (i = 1; i <= KEY_CACHE_SIZE; i++) {
+      add_account(i);
+    }
+
+    // use the first one, so the second is the least recently used
+    assert_non_null(find_account(1));
+
+    add_account(100);
+
+    assert_non_null(find_account(100));
+    assert_non_null(find_account(1));
+    assert_null(find_account(2));
+    for (i = 3; i <= KEY_CACHE_SIZE; i++) {
+      assert_non_null(find_account(i));
+    }
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_key_cache_find),
+      cmocka_unit_test(test_key_cache_lru),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+#include "testing.h"
+#include "../src/sw.h"
+
+#define KV_TEST_PAGES   8
+#define KV_TEST_SIZE    256
+
+// simulated flash: counts the writes and the page erases, and can lose
+// the power in the middle of a write
+
+unsigned char sim_flash[KV_TEST_PAGES * KV_TEST_SIZE];
+unsigned int sim_erases[KV_TEST_PAGES];
+unsigned int sim_writes;
+unsigned int sim_power_loss_at;   // 0 = never
+
+#define POWER_LOSS 0x7777
+
+static void sim_write(void *dst, const void *src, unsigned int len) {
+  unsigned char *ptr = (unsigned char *) dst;
+
+  assert_true(ptr >= sim_flash && ptr + len <= sim_flash + sizeof(sim_flash));
+
+  sim_writes++;
+  if (sim_writes == sim_power_loss_at) {
+    memcpy(dst, src, len / 2);  // torn write
+    THROW(POWER_LOSS);
+  }
+  memcpy(dst, src, len);
+}
+
+static void sim_erase(unsigned int page) {
+  assert_true(page < KV_TEST_PAGES);
+  memset(sim_flash + page * KV_TEST_SIZE, 0xFF, KV_TEST_SIZE);
+  sim_erases[page]++;
+}
+
+static void sim_reset() {
+  memset(sim_flash, 0xFF, sizeof(sim_flash));
+  memset(sim_erases, 0, sizeof(sim_erases));
+  sim_writes = 0;
+  sim_power_loss_at = 0;
+}
+
+#define KV_PAGE_SIZE  KV_TEST_SIZE
+#define KV_NUM_PAGES  KV_TEST_PAGES
+#define N_kv_region sim_flash
+#define kv_flash_write(dst, src, len) sim_write(dst, src, len)
+#define kv_flash_erase(page) sim_erase(page)
+
+#include "../src/kv_store.h"
+
+
+static void put_str(uint16_t key, const char *str) {
+  kv_put(key, str, strlen(str) + 1);
+}
+
+static void assert_value(uint16_t key, const char *expected) {
+  char value[KV_MAX_VALUE];
+  int len = kv_get(key, value, sizeof(value));
+
+  if (expected == NULL) {
+    assert_int_equal(len, -1);
+  } else {
+    assert_int_equal(len, strlen(expected) + 1);
+    assert_string_equal(value, expected);
+  }
+}
+
+static void test_kv_put_get(void **state) {
+    (void) state;
+    char value[4];
+
+    sim_reset();
+    kv_init();
+
+    assert_value(1, NULL);
+
+    put_str(1, "first");
+    put_str(2, "second");
+    put_str(300, "third");
+    assert_value(1, "first");
+    assert_value(2, "second");
+    assert_value(300, "third");
+
+    // replace
+    put_str(2, "updated");
+    assert_value(2, "updated");
+    assert_value(1, "first");
+
+    // smaller buffer
+    assert_int_equal(kv_get(300, value, sizeof(value)), 6);
+    assert_memory_equal(value, "thir", 4);
+
+    // delete
+    kv_delete(1);
+    assert_value(1, NULL);
+    kv_delete(1);
+    assert_value(2, "updated");
+
+    // empty value
+    kv_put(5, "", 0);
+    assert_int_equal(kv_get(5, value, sizeof(value)), 0);
+}
+
+static void test_kv_rebuild_index(void **state) {
+    (void) state;
+
+    sim_reset();
+    kv_init();
+
+    put_str(1, "one");
+    put_str(2, "two");
+    put_str(3, "three");
+    put_str(2, "two again");
+    kv_delete(3);
+
+    // app restart
+    memset(kv_index, 0, sizeof(kv_index));
+    kv_init();
+
+    assert_value(1, "one");
+    assert_value(2, "two again");
+    assert_value(3, NULL);
+
+    // the writes continue after the last record
+    put_str(4, "four");
+    kv_init();
+    assert_value(1, "one");
+    assert_value(4, "four");
+}
+
+static void test_kv_corrupted_record(void **state) {
+    (void) state;
+
+    sim_reset();
+    kv_init();
+
+    put_str(1, "old");
+    put_str(1, "new");
+
+    // corrupt the value of the last record
+    sim_flash[kv_head * KV_PAGE_SIZE + kv_head_offset - 4] ^= 0x01;
+
+    kv_init();
+    assert_value(1, "old");
+
+    // the corrupted record is overwritten
+    put_str(2, "two");
+    kv_init();
+    assert_value(1, "old");
+    assert_value(2, "two");
+}
+
+static void test_kv_wear_leveling(void **state) {
+    (void) state;
+    char value[32];
+    unsigned int i, min, max, total = 0;
+
+    sim_reset();
+    kv_init();
+
+    put_str(100, "constant");
+
+    for (i = 0; i < 3000; i++) {
+      snprintf(value, sizeof(value), "counter %u", i);
+      put_str(i % 5, value);
+    }
+
+    assert_value(100, "constant");
+    for (i = 0; i < 5; i++) {
+      snprintf(value, sizeof(value), "counter %u", 2995 + i);
+      assert_value(i, value);
+    }
+
+    // the erases are spread over all the pages
+    min = max = sim_erases[0];
+    for (i = 0; i < KV_TEST_PAGES; i++) {
+      if (sim_erases[i] < min) min = sim_erases[i];
+      if (sim_erases[i] > max) max = sim_erases[i];
+      total += sim_erases[i];
+    }
+    assert_true(total > 10 * KV_TEST_PAGES);
+    assert_true(max - min <= 1);
+
+    // one write per update, plus the page headers and the copies
+    assert_true(sim_writes < 3000 + 3 * total);
+
+    kv_init();
+    assert_value(100, "constant");
+    assert_value(4, "counter 2999");
+}
+
+static void test_kv_full(void **state) {
+    (void) state;
+    unsigned char value[KV_MAX_VALUE + 1];
+    volatile unsigned int i;
+
+    sim_reset();
+    kv_init();
+
+    memset(value, 0xAB, sizeof(value));
+
+    // value too long
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      kv_put(1, value, KV_MAX_VALUE + 1);
+      fail();
+    }
+    assert_int_equal(ret, SW_WRONG_LENGTH);
+
+    // too many keys
+    for (i = 0; i < KV_MAX_KEYS; i++) {
+      kv_put(i, value, 1);
+    }
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      kv_put(KV_MAX_KEYS, value, 1);
+      fail();
+    }
+    assert_int_equal(ret, SW_STORAGE_FULL);
+
+    // replacing a key is still accepted
+    kv_put(0, "x", 1);
+
+    // no more space
+    sim_reset();
+    kv_init();
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      for (i = 0; i < KV_MAX_KEYS; i++) {
+        kv_put(i, value, KV_MAX_VALUE);
+      }
+      fail();
+    }
+    assert_int_equal(ret, SW_STORAGE_FULL);
+
+    // the stored values are kept
+    unsigned int stored = i;
+    assert_true(stored > 0);
+    kv_init();
+    for (i = 0; i < stored; i++) {
+      assert_int_equal(kv_get(i, value, sizeof(value)), KV_MAX_VALUE);
+      assert_int_equal(value[KV_MAX_VALUE - 1], 0xAB);
+    }
+    assert_int_equal(kv_get(stored, value, sizeof(value)), -1);
+}
+
+static void test_kv_power_loss(void **state) {
+    (void) state;
+    char value[32], expected[6][32], pending[32];
+    volatile unsigned int i;
+    unsigned int cut, key;
+
+    for (cut = 3; cut < 400; cut += 7) {
+
+      sim_reset();
+      kv_init();
+      for (key = 0; key < 6; key++) {
+        snprintf(expected[key], 32, "initial %u", key);
+        put_str(key, expected[key]);
+      }
+
+      sim_power_loss_at = sim_writes + cut;
+      i = 0;
+      key = 0;
+
+      int ret = setjmp(jump_buffer);
+      if (ret == 0) {
+        for (i = 0; i < 1000; i++) {
+          key = i % 6;
+          snprintf(pending, 32, "update %u", (unsigned int) i);
+          put_str(key, pending);
+          strcpy(expected[key], pending);
+        }
+        fail();
+      }
+      assert_int_equal(ret, POWER_LOSS);
+
+      // app restart
+      sim_power_loss_at = 0;
+      kv_init();
+
+      // the interrupted update may or may not be there, the others are
+      for (key = 0; key < 6; key++) {
+        int len = kv_get(key, value, sizeof(value));
+        assert_true(len > 0);
+        if (key == i % 6 && strcmp(value, pending) == 0) {
+          strcpy(expected[key], pending);
+        }
+        assert_string_equal(value, expected[key]);
+      }
+
+      // and it still works
+      for (key = 0; key < 200; key++) {
+        snprintf(expected[key % 6], 32, "after %u", key);
+        put_str(key % 6, expected[key % 6]);
+      }
+      kv_init();
+      for (key = 0; key < 6; key++) {
+        assert_value(key, expected[key]);
+      }
+    }
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_kv_put_get),
+      cmocka_unit_test(test_kv_rebuild_index),
+      cmocka_unit_test(test_kv_corrupted_record),
+      cmocka_unit_test(test_kv_wear_leveling),
+      cmocka_unit_test(test_kv_full),
+      cmocka_unit_test(test_kv_power_loss),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
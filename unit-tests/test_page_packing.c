@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+// built for the Nano S (1 line per page) and, with TARGET_NANOX, for the
+// Nano X and S+ (3 lines per page)
+#ifndef TARGET_NANOX
+#define TARGET_NANOS
+#endif
+#include "../src/display_font.h"
+
+static unsigned int fit_text(const char *text) {
+  return fit_page((const unsigned char *) text, strlen(text), false);
+}
+
+// TEST CASES -------------------------------
+
+static void test_page_packing_short_text(void **state) {
+    (void) state;
+
+    assert_int_equal(fit_text(""), 0);
+    assert_int_equal(fit_text("123.456 AERGO"), 13);
+}
+
+static void test_page_packing_narrow_glyphs(void **state) {
+    (void) state;
+
+    // digits are 6 pixels wide: 18 per line
+    assert_int_equal(fit_text("0123456789012345678901234567890123456789012345678901234567890123456789"),
+                     18 * LINES_PER_PAGE);
+    // narrow glyphs use less space than the wide ones
+    assert_true(fit_text("iiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiiii") > 13);
+    assert_true(fit_text("WWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWW") < 13 * LINES_PER_PAGE);
+    assert_int_equal(fit_text("WWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWWW"), 11 * LINES_PER_PAGE);
+}
+
+static void test_page_packing_address(void **state) {
+    (void) state;
+    const char *address = "AmMDEyc36FNXB3Fq1a61HeVJRT4yssMEP11NWWE9Qx8yhfRKexvq";
+
+    // more than 13 characters per line, according to the glyphs
+#ifdef TARGET_NANOS
+    assert_int_equal(fit_text(address), 15);
+    assert_int_equal(fit_text(address + 15), 17);
+    assert_int_equal(fit_text(address + 32), 15);
+    assert_int_equal(fit_text(address + 47), 5);
+#else
+    assert_int_equal(fit_text(address), 47);
+    assert_int_equal(fit_text(address + 47), 5);
+#endif
+}
+
+static void test_page_packing_words(void **state) {
+    (void) state;
+    const char *words = "aaaaaaaa aaaaaaaa aaaaaaaa aaaaaaaa aaaaaaaa aaaaaaaa aaaaaaaa";
+
+    // like on the SDK paging, the lines are broken at the last space, and
+    // only the last line of the page is filled up to its width
+#ifdef TARGET_NANOS
+    assert_int_equal(fit_text(words), 19);
+#else
+    assert_int_equal(fit_text(words), 18 + 18 + 19);
+    // or dash
+    assert_int_equal(fit_text("aaaaaaaaaa-aaaaaaaaaa-aaaaaaaaaa-aaaaaaaaaa-aaaaaaaaaa"), 11 + 11 + 18);
+#endif
+}
+
+static void test_page_packing_hex(void **state) {
+    (void) state;
+    const unsigned char data[] = {
+      0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99,
+      0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x00, 0x11, 0x22, 0x33,
+      0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd,
+    };
+
+    // each byte is displayed as 2 hex digits
+    assert_int_equal(fit_page(data, 6, true), 6);
+#ifdef TARGET_NANOS
+    assert_int_equal(fit_page(data, sizeof data, true), 9);
+#else
+    assert_int_equal(fit_page(data, sizeof data, true), 26);
+#endif
+}
+
+static void test_page_packing_max_chars(void **state) {
+    (void) state;
+    char text[100];
+
+    // the page never holds more characters than global_text
+    memset(text, '.', sizeof text - 1);
+    text[sizeof text - 1] = 0;
+#ifdef TARGET_NANOS
+    assert_int_equal(fit_text(text), LINE_WIDTH / 3);
+#else
+    assert_int_equal(fit_text(text), MAX_CHARS_PER_PAGE);
+#endif
+}
+
+int main() {
+    const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_page_packing_short_text),
+      cmocka_unit_test(test_page_packing_narrow_glyphs),
+      cmocka_unit_test(test_page_packing_address),
+      cmocka_unit_test(test_page_packing_words),
+      cmocka_unit_test(test_page_packing_hex),
+      cmocka_unit_test(test_page_packing_max_chars),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
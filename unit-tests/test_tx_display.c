@@ -10,7 +10,18 @@
 #include <cmocka.h>
 
 #include "testing.h"
+#define HAVE_STATS
+#define HAVE_TRACE
+#define HAVE_STACK_USAGE
+#define HAVE_GET_SCREEN
+// simulated stack region
+unsigned int sim_stack[64];
+#define STACK_BOTTOM  sim_stack
+#define STACK_TOP     (sim_stack + 64)
+#define stack_paint_end(frame)  ((void)(frame), STACK_TOP)   // the whole region
 #include "../src/globals.h"
+#include "../src/apdu.h"
+#include "../src/sw.h"
 
 char display_title[20];
 char display_text[20];
@@ -37,6 +48,11 @@ void start_display() {
   strcpy(display_text,  "Transaction");
 }
 
+void display_progress() {
+  strcpy(display_title, "Receiving");
+  strcpy(display_text,  global_text);
+}
+
 void update_screen() {
   if (current_state == STATIC_SCREEN) {
     strcpy(display_title, "Review");
@@ -51,8 +67,38 @@ void update_screen() {
 #include "../src/display_pages.h"
 #include "../src/display_text.h"
 
+#include "../src/key_cache.h"
 #include "../src/transaction.h"
+#include "../src/envelope.h"
+#include "../src/stream.h"
+
+struct abi_entry test_abi_registry[ABI_REGISTRY_SIZE];
+#define N_abi_registry test_abi_registry
+#define nvm_write(dst, src, len) memcpy(dst, src, len)
+
+// simulated flash for the key-value store
+#define KV_PAGE_SIZE  256
+#define KV_NUM_PAGES  4
+unsigned char test_kv_region[KV_NUM_PAGES * KV_PAGE_SIZE];
+#define N_kv_region test_kv_region
+
+#include "../src/kv_store.h"
+
+#include "../src/settings.h"
+
+#include "../src/abi_registry.h"
+
+struct address_entry test_address_book[ADDRESS_BOOK_SIZE];
+#define N_address_book test_address_book
+
+#include "../src/address_book.h"
+
+struct policy_entry test_policy_table[POLICY_TABLE_SIZE];
+#define N_policy_table test_policy_table
+
+#include "../src/policy.h"
 #include "../src/selection.h"
+#include "../src/batch.h"
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -114,6 +160,7 @@ void on_posterior_delimiter() {
 unsigned char *txn_ptr;
 unsigned int txn_size;
 unsigned int txn_offset;
+bool txn_is_message;
 
 static void send_next_txn_part() {
   bool is_first, is_last;
@@ -127,7 +174,17 @@ static void send_next_txn_part() {
   is_first = (txn_offset == 0);
   is_last  = (txn_offset + bytes_now == txn_size);
 
-  on_new_transaction_part(txn_ptr + txn_offset, bytes_now, is_first, is_last);
+  if (txn_is_message) {
+    /* the P1 flags sent by the host, read like on the device */
+    unsigned char p1 = 0;
+    if (is_first) p1 |= P1_FIRST;
+    if (is_last) p1 |= P1_LAST;
+    if (!is_first && !is_last) p1 |= P1_MIDDLE;
+    get_message_part(p1, &is_first, &is_last);
+    on_new_message(txn_ptr + txn_offset, bytes_now, false, is_first, is_last);
+  } else {
+    on_new_transaction_part(txn_ptr + txn_offset, bytes_now, is_first, is_last);
+  }
 
   txn_offset += bytes_now;
 
@@ -588,6 +645,158 @@ static void test_tx_display_normal_long_payload(void **state) {
     assert_string_equal(display_text, "0000001 AERGO");
 }
 
+static void test_tx_display_envelope(void **state) {
+    (void) state;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x00,
+        // transaction
+        0x08, 0x82, 0x20, 0x12, 0x21, 0x02, 0x9d, 0x02,
+        0x05, 0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53,
+        0x68, 0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac,
+        0x98, 0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c,
+        0x06, 0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21,
+        0x02, 0x5d, 0x22, 0x30, 0xba, 0x75, 0x21, 0x7e,
+        0x60, 0x37, 0x99, 0xe9, 0xa3, 0xd5, 0xb9, 0x1a,
+        0x63, 0x61, 0x48, 0x3f, 0x9d, 0xa7, 0x37, 0x96,
+        0x41, 0x0f, 0x6b, 0xc1, 0xce, 0x58, 0x01, 0xfd,
+        0xf2, 0x22, 0x01, 0x01, 0x2a, 0x9b, 0x01, 0x54,
+        0x65, 0x73, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x61,
+        0x20, 0x6c, 0x6f, 0x6e, 0x67, 0x20, 0x70, 0x61,
+        0x79, 0x6c, 0x6f, 0x61, 0x64, 0x20, 0x74, 0x65,
+        0x78, 0x74, 0x20, 0x69, 0x6e, 0x20, 0x77, 0x68,
+        0x69, 0x63, 0x68, 0x20, 0x6f, 0x6e, 0x6c, 0x79,
+        0x20, 0x74, 0x68, 0x65, 0x20, 0x66, 0x69, 0x72,
+        0x73, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x20,
+        0x77, 0x69, 0x6c, 0x6c, 0x20, 0x62, 0x65, 0x20,
+        0x64, 0x69, 0x73, 0x70, 0x6c, 0x61, 0x79, 0x65,
+        0x64, 0x2c, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61,
+        0x6c, 0x6c, 0x20, 0x74, 0x68, 0x65, 0x20, 0x72,
+        0x65, 0x6d, 0x61, 0x69, 0x6e, 0x69, 0x6e, 0x67,
+        0x20, 0x77, 0x69, 0x6c, 0x6c, 0x20, 0x62, 0x65,
+        0x20, 0x68, 0x69, 0x64, 0x64, 0x65, 0x6e, 0x20,
+        0x62, 0x75, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20,
+        0x74, 0x78, 0x6e, 0x20, 0x68, 0x61, 0x73, 0x68,
+        0x20, 0x77, 0x69, 0x6c, 0x6c, 0x20, 0x62, 0x65,
+        0x20, 0x63, 0x6f, 0x6d, 0x70, 0x75, 0x74, 0x65,
+        0x64, 0x20, 0x70, 0x72, 0x6f, 0x70, 0x65, 0x72,
+        0x6c, 0x79, 0x3a, 0x01, 0x00, 0x4a, 0x20, 0x52,
+        0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5, 0x3a, 0xec,
+        0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62, 0xdc, 0x95,
+        0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93, 0x0b, 0xc2,
+        0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53, 0xbd,
+    };
+
+    unsigned char envelope[ENVELOPE_SIZE] = {
+        // total length
+        0x00, 0x00, 0x01, 0x10,
+        // payload length
+        0x00, 0x00, 0x00, 0x9b,
+        // tx type
+        0x00,
+        // chain id
+        0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5, 0x3a,
+        0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62, 0xdc,
+        0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93, 0x0b,
+        0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53, 0xbd,
+    };
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_txn_envelope(envelope, sizeof(envelope));
+    assert_true(txn_declared);
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+
+    click_next();
+    assert_string_equal(display_title, "Payload 1/2");
+    assert_string_equal(display_text, "Testing a lon");
+
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Payload 1/2");
+    assert_string_equal(display_text, "ly the first ");
+
+    click_next();
+    assert_string_equal(display_title, "Payload 1/2");
+    assert_string_equal(display_text, "part will ...");
+    assert_false(txn_is_complete);
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+    assert_true(txn_is_complete);
+    assert_int_equal(arena.txn.envelope.part_num, 2);
+
+    // BACKWARDS - it requests the first part again
+
+    click_prev();
+    assert_string_equal(display_title, "Payload 2/2");
+    assert_string_equal(display_text, "part will ...");
+
+    click_prev();
+    assert_string_equal(display_title, "Payload 1/2");
+    assert_string_equal(display_text, "ly the first ");
+
+    // a different transaction type is rejected on the first part
+
+    envelope[8] = 0x04;
+    on_txn_envelope(envelope, sizeof(envelope));
+
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      send_transaction(raw_tx, sizeof(raw_tx));
+      fail();
+    }
+    assert_int_equal(ret, SW_ENVELOPE_MISMATCH);
+    assert_false(txn_declared);
+    assert_int_equal(txn_offset, 0);
+
+    // a different chain is rejected when the transaction is complete
+
+    envelope[8] = 0x00;
+    envelope[40] = 0x00;
+    on_txn_envelope(envelope, sizeof(envelope));
+
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      send_transaction(raw_tx, sizeof(raw_tx));
+      for (int i = 0; i < 20 && !txn_is_complete; i++) {
+        click_next();
+      }
+      fail();
+    }
+    assert_int_equal(ret, SW_ENVELOPE_MISMATCH);
+    assert_false(txn_is_complete);
+
+    // an invalid envelope
+
+    envelope[40] = 0xbd;
+    envelope[2] = 0x00;  // shorter than the payload
+
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_txn_envelope(envelope, sizeof(envelope));
+      fail();
+    }
+    assert_int_equal(ret, SW_INVALID_ENVELOPE);
+    assert_false(txn_declared);
+}
+
 // TRANSFER
 static void test_tx_display_transfer_1(void **state) {
     (void) state;
@@ -4976,6 +5185,194 @@ test_tx_display_governance_change_cluster (void **state){
 
 }
 
+// BATCH OF TRANSFERS
+static void test_tx_display_batch(void **state) {
+    (void) state;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x04,
+        // transaction
+        0x08, 0x0a, 0x12, 0x21, 0x02, 0x9d, 0x02, 0x05,
+        0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53, 0x68,
+        0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac, 0x98,
+        0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c, 0x06,
+        0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21, 0x03,
+        0x8c, 0xb9, 0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69,
+        0x09, 0x3c, 0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9,
+        0xfa, 0x50, 0x17, 0x30, 0x42, 0x23, 0xf9, 0xad,
+        0x1a, 0x8c, 0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb,
+        0x22, 0x08, 0x14, 0xd1, 0x12, 0x0d, 0x7b, 0x16,
+        0x00, 0x00, 0x3a, 0x01, 0x00, 0x40, 0x04, 0x4a,
+        0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5,
+        0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62,
+        0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93,
+        0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53,
+        0xbd,
+    };
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_new_batch_txn(raw_tx, sizeof(raw_tx), true, false);
+    assert_int_equal(batch_count, 1);
+    on_new_batch_txn(raw_tx, sizeof(raw_tx), false, true);
+    assert_int_equal(batch_count, 2);
+
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    assert_string_equal(display_title, "Transfers");
+    assert_string_equal(display_text, "2");
+
+    click_next();
+    assert_string_equal(display_title, "Total");
+    assert_string_equal(display_text, "3 AERGO");
+
+    click_next();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "AmPWwmdgpvPRP");
+
+    click_next();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "tykgCCWvVdZS6");
+
+    click_next();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "h7b6w9UzcLcsE");
+
+    click_next();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "d64mzKJ9RCAhp");
+
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "524845C24CD3");
+
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "E53AECBCDA8E");
+
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "315D62DC95A7");
+
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "F2F82548930B");
+
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "C2FCC986BF74");
+
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "53BD");
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    // BACKWARDS
+
+    click_prev();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "53BD");
+
+    click_prev();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "C2FCC986BF74");
+
+    click_prev();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "F2F82548930B");
+
+    click_prev();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "315D62DC95A7");
+
+    click_prev();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "E53AECBCDA8E");
+
+    click_prev();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "524845C24CD3");
+
+    click_prev();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "d64mzKJ9RCAhp");
+
+    click_prev();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "h7b6w9UzcLcsE");
+
+    click_prev();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "tykgCCWvVdZS6");
+
+    click_prev();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "AmPWwmdgpvPRP");
+
+    click_prev();
+    assert_string_equal(display_title, "Total");
+    assert_string_equal(display_text, "3 AERGO");
+
+    click_prev();
+    assert_string_equal(display_title, "Transfers");
+    assert_string_equal(display_text, "2");
+
+    click_prev();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+}
+
+static void test_tx_display_batch_during_review(void **state) {
+    (void) state;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x04,
+        // transaction
+        0x08, 0x0a, 0x12, 0x21, 0x02, 0x9d, 0x02, 0x05,
+        0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53, 0x68,
+        0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac, 0x98,
+        0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c, 0x06,
+        0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21, 0x03,
+        0x8c, 0xb9, 0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69,
+        0x09, 0x3c, 0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9,
+        0xfa, 0x50, 0x17, 0x30, 0x42, 0x23, 0xf9, 0xad,
+        0x1a, 0x8c, 0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb,
+        0x22, 0x08, 0x14, 0xd1, 0x12, 0x0d, 0x7b, 0x16,
+        0x00, 0x00, 0x3a, 0x01, 0x00, 0x40, 0x04, 0x4a,
+        0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5,
+        0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62,
+        0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93,
+        0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53,
+        0xbd,
+    };
+    unsigned char hash[32];
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      /* a transfer waiting for the approval */
+      send_transaction(raw_tx, sizeof(raw_tx));
+      assert_true(txn_is_complete);
+      assert_int_equal(stream_ins, INS_SIGN_TXN);
+      memcpy(hash, txn_hash, 32);
+      /* a batch part cannot replace its hash */
+      on_new_batch_txn(raw_tx, sizeof(raw_tx), false, false);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(stream_ins, INS_SIGN_TXN);
+    assert_memory_equal(txn_hash, hash, 32);
+}
+
 // MESSAGE
 static void test_display_message(void **state) {
     (void) state;
@@ -4985,7 +5382,7 @@ static void test_display_message(void **state) {
     int ret = setjmp(jump_buffer);
     assert_int_equal(ret, 0);
 
-    on_new_message(message, strlen((char*)message), false);
+    on_new_message(message, strlen((char*)message), false, true, true);
 
     assert_string_equal(display_title, "Review");
     assert_string_equal(display_text, "Transaction");
@@ -5061,14 +5458,1301 @@ static void test_display_message(void **state) {
     assert_string_equal(display_text, "This message ");
 }
 
-// Message ADDRESS
-static void test_display_account(void **state) {
+static void test_message_part_flags(void **state) {
     (void) state;
+    bool is_first, is_last;
+
+    get_message_part(0, &is_first, &is_last);
+    assert_true(is_first && is_last);
+    get_message_part(P1_FIRST | P1_LAST, &is_first, &is_last);
+    assert_true(is_first && is_last);
+    get_message_part(P1_FIRST, &is_first, &is_last);
+    assert_true(is_first && !is_last);
+    get_message_part(P1_MIDDLE, &is_first, &is_last);
+    assert_true(!is_first && !is_last);
+    get_message_part(P1_LAST, &is_first, &is_last);
+    assert_true(!is_first && is_last);
+}
 
-    // clang-format off
-    uint8_t public_key_bytes[] = {
-        0x01, 0x02,
-        0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+static void test_display_long_message(void **state) {
+    (void) state;
+
+    char message[521];
+    char shown[600];
+    unsigned char expected_hash[32];
+    int i, pos;
+
+    /* 3 parts: first, middle and last */
+    for (i = 0; i < 520; i++) {
+      message[i] = 'a' + (i % 26);
+    }
+    message[520] = 0;
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    txn_ptr = (unsigned char *) message;
+    txn_size = 520;
+    txn_offset = 0;
+    txn_is_message = true;
+
+    requested_part = FIRST_PART;
+    check_send_txn_part();
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+    assert_false(txn_is_complete);
+
+    /* the next parts are requested while going through the pages */
+
+    pos = 0;
+    click_next();
+    while (strcmp(display_title, "Message") == 0) {
+      strcpy(shown + pos, display_text);
+      pos += strlen(display_text);
+      click_next();
+    }
+    shown[pos] = 0;
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(shown, message);
+    assert_true(txn_is_complete);
+
+    /* the hash is calculated over all the parts */
+
+    cx_sha256_t ctx;
+    sha256_init(ctx);
+    sha256_add(ctx, message, 520);
+    sha256_finish(ctx, expected_hash);
+    assert_memory_equal(txn_hash, expected_hash, 32);
+
+    /* going backwards requests the first part again */
+
+    pos = sizeof(shown) - 1;
+    shown[pos] = 0;
+    click_prev();
+    while (strcmp(display_title, "Message") == 0) {
+      pos -= strlen(display_text);
+      memcpy(shown + pos, display_text, strlen(display_text));
+      click_prev();
+    }
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(shown + pos, message);
+    assert_memory_equal(txn_hash, expected_hash, 32);
+
+    txn_is_message = false;
+}
+
+// STREAM OF PARTS
+static void test_stream_owner(void **state) {
+    (void) state;
+
+    unsigned char message[60];
+    unsigned char hash[32];
+
+    memset(message, 'a', sizeof message);
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      /* a message in many parts, waiting for the next one */
+      on_new_message(message, sizeof message, false, true, false);
+      assert_int_equal(stream_ins, INS_SIGN_MSG);
+      assert_false(txn_is_complete);
+      memcpy(hash, txn_hash, 32);
+      /* a transaction part cannot continue it */
+      on_new_transaction_part(message, sizeof message, false, true);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(stream_ins, INS_SIGN_MSG);
+    assert_memory_equal(txn_hash, hash, 32);
+
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      /* neither a batch part */
+      on_new_batch_txn(message, sizeof message, false, true);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(stream_ins, INS_SIGN_MSG);
+    assert_memory_equal(txn_hash, hash, 32);
+    assert_false(txn_is_complete);
+}
+
+static void test_stream_message_format(void **state) {
+    (void) state;
+
+    unsigned char message[60];
+
+    memset(message, 'c', sizeof message);
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_new_message(message, sizeof message, false, true, false);
+      /* a part in hex cannot continue a text message */
+      on_new_message(message, sizeof message, true, false, true);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(stream_ins, INS_SIGN_MSG);
+    assert_false(txn_is_complete);
+}
+
+static void test_stream_reset(void **state) {
+    (void) state;
+
+    unsigned char message[60];
+
+    memset(message, 'b', sizeof message);
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_new_message(message, sizeof message, false, true, false);
+      assert_int_equal(stream_ins, INS_SIGN_MSG);
+      /* a command that writes on the arena, like GET_PUBLIC_KEYS */
+      reset_stream();
+      /* the next part of the message is rejected */
+      on_new_message(message, sizeof message, false, false, true);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(stream_ins, 0);
+    assert_false(txn_is_complete);
+}
+
+static void test_stream_approve(void **state) {
+    (void) state;
+
+    unsigned char message[60];
+
+    memset(message, 'd', sizeof message);
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_new_message(message, sizeof message, false, true, true);
+      assert_int_equal(stream_ins, INS_SIGN_MSG);
+      /* the read-only commands and the parts of the same command keep it */
+      assert_false(stream_is_ended_by(INS_GET_APP_VERSION));
+      assert_false(stream_is_ended_by(INS_SIGN_MSG));
+      /* the others end it */
+      assert_true(stream_is_ended_by(INS_GET_EXTENDED_KEY));
+      assert_true(stream_is_ended_by(INS_GET_PUBLIC_KEYS));
+      /* the approval of another command is rejected */
+      stream_approve(INS_SIGN_BATCH);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(stream_ins, INS_SIGN_MSG);
+
+    ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+    stream_approve(INS_SIGN_MSG);
+    assert_int_equal(stream_ins, 0);
+    assert_false(stream_is_ended_by(INS_GET_EXTENDED_KEY));
+}
+
+// SETTINGS
+
+/* goes through the payload pages, returning their concatenated text */
+static void read_payload_pages(char *out) {
+  out[0] = 0;
+  do {
+    click_next();
+  } while (strcmp(display_title, "Payload") != 0);
+  while (strcmp(display_title, "Payload") == 0) {
+    strcat(out, display_text);
+    click_next();
+  }
+}
+
+static void test_tx_display_settings(void **state) {
+    (void) state;
+
+    // clang-format off
+    uint8_t binary_tx[] = {
+        // tx type
+        0x00,
+        // transaction
+        0x08, 0x01, 0x12, 0x21, 0x02, 0x9d, 0x02, 0x05,
+        0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53, 0x68,
+        0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac, 0x98,
+        0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c, 0x06,
+        0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21, 0x02,
+        0x5d, 0x22, 0x30, 0xba, 0x75, 0x21, 0x7e, 0x60,
+        0x37, 0x99, 0xe9, 0xa3, 0xd5, 0xb9, 0x1a, 0x63,
+        0x61, 0x48, 0x3f, 0x9d, 0xa7, 0x37, 0x96, 0x41,
+        0x0f, 0x6b, 0xc1, 0xce, 0x58, 0x01, 0xfd, 0xf2,
+        0x22, 0x09, 0x06, 0xb1, 0x4b, 0xd1, 0xe6, 0xee,
+        0xa0, 0x00, 0x00, 0x2a, 0x31, 0x00, 0x01, 0x02,
+        0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+        0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12,
+        0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a,
+        0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22,
+        0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a,
+        0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+        0x3a, 0x01, 0x00, 0x4a, 0x20, 0x52, 0x48,
+        0x45, 0xc2, 0x4c, 0xd3, 0xe5, 0x3a, 0xec, 0xbc,
+        0xda, 0x8e, 0x31, 0x5d, 0x62, 0xdc, 0x95, 0xa7,
+        0xf2, 0xf8, 0x25, 0x48, 0x93, 0x0b, 0xc2, 0xfc,
+        0xc9, 0x86, 0xbf, 0x74, 0x53, 0xbd,
+    };
+
+    uint8_t long_tx[] = {
+        // tx type
+        0x00,
+        // transaction
+        0x08, 0x82, 0x20, 0x12, 0x21, 0x02, 0x9d, 0x02,
+        0x05, 0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53,
+        0x68, 0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac,
+        0x98, 0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c,
+        0x06, 0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21,
+        0x02, 0x5d, 0x22, 0x30, 0xba, 0x75, 0x21, 0x7e,
+        0x60, 0x37, 0x99, 0xe9, 0xa3, 0xd5, 0xb9, 0x1a,
+        0x63, 0x61, 0x48, 0x3f, 0x9d, 0xa7, 0x37, 0x96,
+        0x41, 0x0f, 0x6b, 0xc1, 0xce, 0x58, 0x01, 0xfd,
+        0xf2, 0x22, 0x01, 0x01, 0x2a, 0x9b, 0x01, 0x54,
+        0x65, 0x73, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x61,
+        0x20, 0x6c, 0x6f, 0x6e, 0x67, 0x20, 0x70, 0x61,
+        0x79, 0x6c, 0x6f, 0x61, 0x64, 0x20, 0x74, 0x65,
+        0x78, 0x74, 0x20, 0x69, 0x6e, 0x20, 0x77, 0x68,
+        0x69, 0x63, 0x68, 0x20, 0x6f, 0x6e, 0x6c, 0x79,
+        0x20, 0x74, 0x68, 0x65, 0x20, 0x66, 0x69, 0x72,
+        0x73, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x20,
+        0x77, 0x69, 0x6c, 0x6c, 0x20, 0x62, 0x65, 0x20,
+        0x64, 0x69, 0x73, 0x70, 0x6c, 0x61, 0x79, 0x65,
+        0x64, 0x2c, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61,
+        0x6c, 0x6c, 0x20, 0x74, 0x68, 0x65, 0x20, 0x72,
+        0x65, 0x6d, 0x61, 0x69, 0x6e, 0x69, 0x6e, 0x67,
+        0x20, 0x77, 0x69, 0x6c, 0x6c, 0x20, 0x62, 0x65,
+        0x20, 0x68, 0x69, 0x64, 0x64, 0x65, 0x6e, 0x20,
+        0x62, 0x75, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20,
+        0x74, 0x78, 0x6e, 0x20, 0x68, 0x61, 0x73, 0x68,
+        0x20, 0x77, 0x69, 0x6c, 0x6c, 0x20, 0x62, 0x65,
+        0x20, 0x63, 0x6f, 0x6d, 0x70, 0x75, 0x74, 0x65,
+        0x64, 0x20, 0x70, 0x72, 0x6f, 0x70, 0x65, 0x72,
+        0x6c, 0x79, 0x3a, 0x01, 0x00, 0x4a, 0x20, 0x52,
+        0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5, 0x3a, 0xec,
+        0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62, 0xdc, 0x95,
+        0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93, 0x0b, 0xc2,
+        0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53, 0xbd,
+    };
+
+    char text[400];
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    memset(test_kv_region, 0, sizeof(test_kv_region));
+    kv_init();
+    settings_init();
+
+    // binary payload in hex
+
+    settings_set_binary_as_hex(true);
+
+    send_transaction(binary_tx, sizeof(binary_tx));
+    read_payload_pages(text);
+    assert_string_equal(text,
+      "000102030405060708090A0B0C0D0E0F"
+      "101112131415161718191A1B1C1D1E1F"
+      "202122232425262728292A2B2C2D2E2F30");
+
+    // a text payload is not affected
+
+    send_transaction(long_tx, sizeof(long_tx));
+    read_payload_pages(text);
+    assert_string_equal(text, "Testing a long payload text in which only the first part will ...");
+
+    settings_set_binary_as_hex(false);
+
+    // more pages from long payloads
+
+    settings_set_page_limit(PAGE_LIMIT_8);
+
+    send_transaction(long_tx, sizeof(long_tx));
+    read_payload_pages(text);
+    /* the limit counts the pages after the first one, like the default */
+    assert_int_equal(strlen(text), 9 * 13);
+    assert_memory_equal(text + 9 * 13 - 3, "...", 3);
+
+    // the whole payload
+
+    settings_set_page_limit(PAGE_LIMIT_ALL);
+
+    send_transaction(long_tx, sizeof(long_tx));
+    read_payload_pages(text);
+    assert_string_equal(text,
+      "Testing a long payload text in which only the first part will be "
+      "displayed, and all the remaining will be hidden but the txn hash "
+      "will be computed properly");
+
+    // the settings are read from the store on the app start
+
+    memset(&settings, 0, sizeof(settings));
+    kv_init();
+    settings_init();
+    assert_int_equal(settings.page_limit, PAGE_LIMIT_ALL);
+    assert_int_equal(settings.binary_as_hex, 0);
+
+    settings_set_page_limit(PAGE_LIMIT_4);
+}
+
+// CONTRACT ABI REGISTRY
+static unsigned char abi_send[] = {
+    // contract
+        0x03, 0x8c, 0xb9, 0x2c, 0xde, 0xbf, 0x39, 0x98,
+        0x69, 0x09, 0x3c, 0xac, 0x47, 0xe3, 0x70, 0xd8,
+        0xa9, 0xfa, 0x50, 0x17, 0x30, 0x42, 0x23, 0xf9,
+        0xad, 0x1a, 0x8c, 0x0a, 0x05, 0xa9, 0x06, 0xa9,
+        0xcb,
+    // function
+    0x04, 's', 'e', 'n', 'd',
+    // arguments
+    0x03,
+    ABI_ARG_TEXT,   0x02, 't', 'o',
+    ABI_ARG_AMOUNT, 0x06, 'a', 'm', 'o', 'u', 'n', 't',
+    ABI_ARG_NUMBER, 0x05, 'c', 'o', 'u', 'n', 't',
+};
+
+static void test_abi_register(void **state) {
+    (void) state;
+
+    memset(test_abi_registry, 0, sizeof(test_abi_registry));
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_register_abi(abi_send, sizeof(abi_send));
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    assert_string_equal(display_title, "Contract");
+    assert_string_equal(display_text, "AmPWwmdgpvPRP");
+
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Contract");
+    assert_string_equal(display_text, "d64mzKJ9RCAhp");
+
+    click_next();
+    assert_string_equal(display_title, "Function");
+    assert_string_equal(display_text, "send");
+
+    click_next();
+    assert_string_equal(display_title, "Arguments");
+    assert_string_equal(display_text, "to, amount (A");
+
+    click_next();
+    assert_string_equal(display_title, "Arguments");
+    assert_string_equal(display_text, "ERGO), count ");
+
+    click_next();
+    assert_string_equal(display_title, "Arguments");
+    assert_string_equal(display_text, "(number)");
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    // not stored before the approval
+    assert_null(abi_lookup(abi_send, "send", 4));
+    assert_int_equal(stream_ins, INS_REGISTER_ABI);
+
+    on_abi_approved();
+    assert_int_equal(stream_ins, 0);
+
+    struct abi_entry *entry = abi_lookup(abi_send, "send", 4);
+    assert_non_null(entry);
+    assert_int_equal(entry->num_args, 3);
+    assert_string_equal(entry->arg_names[1], "amount");
+    assert_int_equal(entry->arg_types[1], ABI_ARG_AMOUNT);
+    assert_null(abi_lookup(abi_send, "sen", 3));
+
+    // invalid entries
+
+    abi_send[33] = ABI_FUNCTION_LEN + 1;
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_register_abi(abi_send, sizeof(abi_send));
+      fail();
+    }
+    assert_int_not_equal(ret, 0);
+    abi_send[33] = 0x04;
+
+    abi_send[39] = ABI_ARG_AMOUNT + 1;
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_register_abi(abi_send, sizeof(abi_send));
+      fail();
+    }
+    assert_int_equal(ret, SW_INVALID_ABI);
+    abi_send[39] = ABI_ARG_TEXT;
+}
+
+static void test_abi_register_other_command(void **state) {
+    (void) state;
+
+    memset(test_abi_registry, 0, sizeof(test_abi_registry));
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_register_abi(abi_send, sizeof(abi_send));
+      /* a GET_EXTENDED_KEY arrives while the entry is displayed. it ends
+         the review, then writes its path over the entry */
+      assert_true(stream_is_ended_by(INS_GET_EXTENDED_KEY));
+      reset_stream();
+      memset(arena.xkey.path, 0x55, sizeof arena.xkey.path);
+      /* the approval does not store the changed entry */
+      on_abi_approved();
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_null(abi_lookup(abi_send, "send", 4));
+    assert_null(abi_lookup(arena.abi.entry.contract, "send", 4));
+}
+
+static void test_abi_registry_full(void **state) {
+    (void) state;
+    char name[8];
+    int i;
+
+    memset(test_abi_registry, 0, sizeof(test_abi_registry));
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    /* different functions of the same contract, some on the same slot */
+    for (i = 0; i < ABI_REGISTRY_SIZE; i++) {
+      struct abi_entry entry = {0};
+      memcpy(entry.contract, abi_send, 33);
+      sprintf(name, "fn%d", i);
+      strcpy(entry.function, name);
+      entry.key = abi_key(entry.contract, name, strlen(name));
+      abi_store(&entry);
+    }
+
+    for (i = 0; i < ABI_REGISTRY_SIZE; i++) {
+      sprintf(name, "fn%d", i);
+      struct abi_entry *entry = abi_lookup(abi_send, name, strlen(name));
+      assert_non_null(entry);
+      assert_string_equal(entry->function, name);
+    }
+    assert_null(abi_lookup(abi_send, "send", 4));
+
+    /* an existing entry can be replaced */
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      struct abi_entry entry = {0};
+      memcpy(entry.contract, abi_send, 33);
+      strcpy(entry.function, "fn3");
+      entry.num_args = 1;
+      entry.key = abi_key(entry.contract, "fn3", 3);
+      abi_store(&entry);
+      assert_int_equal(abi_lookup(abi_send, "fn3", 3)->num_args, 1);
+    } else {
+      fail();
+    }
+
+    /* there is no space for a new one */
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_register_abi(abi_send, sizeof(abi_send));
+      fail();
+    }
+    assert_int_equal(ret, SW_ABI_REGISTRY_FULL);
+
+    abi_clear_registry();
+    assert_null(abi_lookup(abi_send, "fn3", 3));
+}
+
+static void test_tx_display_call_abi(void **state) {
+    (void) state;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x05,
+        // transaction
+        0x08, 0x19, 0x12, 0x21, 0x02, 0x9d, 0x02, 0x05,
+        0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53, 0x68,
+        0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac, 0x98,
+        0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c, 0x06,
+        0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21, 0x03,
+        0x8c, 0xb9, 0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69,
+        0x09, 0x3c, 0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9,
+        0xfa, 0x50, 0x17, 0x30, 0x42, 0x23, 0xf9, 0xad,
+        0x1a, 0x8c, 0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb,
+        0x22, 0x01, 0x00, 0x2a, 0x51, 0x7b, 0x22, 0x4e,
+        0x61, 0x6d, 0x65, 0x22, 0x3a, 0x22, 0x73, 0x65,
+        0x6e, 0x64, 0x22, 0x2c, 0x22, 0x41, 0x72, 0x67,
+        0x73, 0x22, 0x3a, 0x5b, 0x22, 0x62, 0x6f, 0x62,
+        0x22, 0x2c, 0x7b, 0x22, 0x5f, 0x62, 0x69, 0x67,
+        0x6e, 0x75, 0x6d, 0x22, 0x3a, 0x22, 0x31, 0x35,
+        0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,
+        0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30,
+        0x30, 0x22, 0x7d, 0x2c, 0x7b, 0x22, 0x5f, 0x62,
+        0x69, 0x67, 0x6e, 0x75, 0x6d, 0x22, 0x3a, 0x22,
+        0x34, 0x32, 0x22, 0x7d, 0x5d, 0x7d, 0x3a, 0x01,
+        0x00, 0x40, 0x05, 0x4a, 0x20, 0x52, 0x48, 0x45,
+        0xc2, 0x4c, 0xd3, 0xe5, 0x3a, 0xec, 0xbc, 0xda,
+        0x8e, 0x31, 0x5d, 0x62, 0xdc, 0x95, 0xa7, 0xf2,
+        0xf8, 0x25, 0x48, 0x93, 0x0b, 0xc2, 0xfc, 0xc9,
+        0x86, 0xbf, 0x74, 0x53, 0xbd,
+    };
+
+    memset(test_abi_registry, 0, sizeof(test_abi_registry));
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_register_abi(abi_send, sizeof(abi_send));
+    abi_store(&arena.abi.entry);
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Contract");
+    assert_string_equal(display_text, "d64mzKJ9RCAhp");
+
+    click_next();
+    assert_string_equal(display_title, "Function");
+    assert_string_equal(display_text, "send");
+
+    click_next();
+    assert_string_equal(display_title, "to");
+    assert_string_equal(display_text, "bob");
+
+    click_next();
+    assert_string_equal(display_title, "amount");
+    assert_string_equal(display_text, "1.5 AERGO");
+
+    click_next();
+    assert_string_equal(display_title, "count");
+    assert_string_equal(display_text, "42");
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    // BACKWARDS
+
+    click_prev();
+    assert_string_equal(display_title, "count");
+    assert_string_equal(display_text, "42");
+
+    click_prev();
+    assert_string_equal(display_title, "amount");
+    assert_string_equal(display_text, "1.5 AERGO");
+
+    // without the registry entry the arguments are displayed as usual
+
+    abi_clear_registry();
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Function");
+    assert_string_equal(display_text, "send");
+
+    click_next();
+    assert_string_equal(display_title, "Parameters");
+    assert_string_equal(display_text, "\"bob\",{\"_bign");
+
+    // an amount that cannot be shown in AERGO is not shown as raw aer
+
+    on_register_abi(abi_send, sizeof(abi_send));
+    abi_store(&arena.abi.entry);
+
+    assert_int_equal(raw_tx[119], '1');
+    raw_tx[119] = 'x';
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Function");
+    assert_string_equal(display_text, "send");
+
+    click_next();
+    assert_string_equal(display_title, "Parameters");
+    assert_string_equal(display_text, "\"bob\",{\"_bign");
+
+    abi_clear_registry();
+}
+
+// ADDRESS BOOK
+static void test_address_book_add(void **state) {
+    (void) state;
+
+    unsigned char contact[33 + 1 + 12];
+
+    memcpy(contact, abi_send, 33);
+    contact[33] = 12;
+    memcpy(contact + 34, "Exchange-Hot", 12);
+
+    memset(test_address_book, 0, sizeof(test_address_book));
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_add_address(contact, sizeof(contact));
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    assert_string_equal(display_title, "Address");
+    assert_string_equal(display_text, "AmPWwmdgpvPRP");
+
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Address");
+    assert_string_equal(display_text, "d64mzKJ9RCAhp");
+
+    click_next();
+    assert_string_equal(display_title, "Label");
+    assert_string_equal(display_text, "Exchange-Hot");
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    // not stored before the approval
+    assert_null(address_lookup(contact));
+    assert_int_equal(stream_ins, INS_ADD_ADDRESS);
+
+    on_address_approved();
+    assert_int_equal(stream_ins, 0);
+
+    struct address_entry *entry = address_lookup(contact);
+    assert_non_null(entry);
+    assert_string_equal(entry->label, "Exchange-Hot");
+
+    // invalid label
+
+    contact[40] = '\n';
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_add_address(contact, sizeof(contact));
+      fail();
+    }
+    assert_int_equal(ret, SW_INVALID_LABEL);
+}
+
+static void test_address_book_other_command(void **state) {
+    (void) state;
+
+    unsigned char contact[33 + 1 + 12];
+    struct address_entry other;
+
+    memcpy(contact, abi_send, 33);
+    contact[33] = 12;
+    memcpy(contact + 34, "Exchange-Hot", 12);
+
+    /* another address, with its key */
+    memset(&other, 0, sizeof other);
+    memcpy(other.address, abi_send, 33);
+    other.address[32] ^= 0xFF;
+    other.key = address_key(other.address);
+
+    memset(test_address_book, 0, sizeof(test_address_book));
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_add_address(contact, sizeof(contact));
+      /* a GET_PUBLIC_KEYS arrives while the entry is displayed. it ends the
+         review, then writes its path over the key and the address */
+      assert_true(stream_is_ended_by(INS_GET_PUBLIC_KEYS));
+      reset_stream();
+      memcpy(arena.keys.path, &other, 4 + 33);
+      /* the approval does not store the changed entry */
+      on_address_approved();
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_null(address_lookup(contact));
+    assert_null(address_lookup(other.address));
+}
+
+static void test_address_book_full(void **state) {
+    (void) state;
+    unsigned char contact[33 + 1 + 4];
+    int i;
+
+    memset(test_address_book, 0, sizeof(test_address_book));
+    memset(contact, 0, sizeof(contact));
+    contact[33] = 4;
+    memcpy(contact + 34, "name", 4);
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    for (i = 0; i < ADDRESS_BOOK_SIZE; i++) {
+      contact[0] = i;
+      on_add_address(contact, sizeof(contact));
+      address_store(&arena.contact.entry);
+    }
+    for (i = 0; i < ADDRESS_BOOK_SIZE; i++) {
+      contact[0] = i;
+      assert_non_null(address_lookup(contact));
+    }
+
+    contact[0] = ADDRESS_BOOK_SIZE;
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_add_address(contact, sizeof(contact));
+      fail();
+    }
+    assert_int_equal(ret, SW_ADDRESS_BOOK_FULL);
+
+    address_book_clear();
+    contact[0] = 0;
+    assert_null(address_lookup(contact));
+}
+
+static void test_signing_policy(void **state) {
+    (void) state;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x01,
+        // transaction
+        0x08, 0x82, 0x20, 0x12, 0x21, 0x02, 0x9d, 0x02,
+        0x05, 0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53,
+        0x68, 0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac,
+        0x98, 0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c,
+        0x06, 0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x0c,
+        0x61, 0x65, 0x72, 0x67, 0x6f, 0x2e, 0x73, 0x79,
+        0x73, 0x74, 0x65, 0x6d, 0x22, 0x09, 0x06, 0xb1,
+        0x4b, 0xd1, 0xe6, 0xee, 0xa0, 0x00, 0x00, 0x2a,
+        0x12, 0x7b, 0x22, 0x4e, 0x61, 0x6d, 0x65, 0x22,
+        0x3a, 0x22, 0x76, 0x31, 0x73, 0x74, 0x61, 0x6b,
+        0x65, 0x22, 0x7d, 0x3a, 0x01, 0x00, 0x40, 0x01,
+        0x4a, 0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3,
+        0xe5, 0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d,
+        0x62, 0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48,
+        0x93, 0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74,
+        0x53, 0xbd,
+    };
+
+    // aergo.system | v1stake | chain ID | up to 200 AERGO | nonces 4090 to 4099
+    uint8_t policy[] = {
+        0x0c, 'a', 'e', 'r', 'g', 'o', '.', 's', 'y', 's', 't', 'e', 'm',
+        0x07, 'v', '1', 's', 't', 'a', 'k', 'e',
+        0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5, 0x3a,
+        0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62, 0xdc,
+        0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93, 0x0b,
+        0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53, 0xbd,
+        0x09, 0x0a, 0xd7, 0x8e, 0xbc, 0x5a, 0xc6, 0x20, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xfa,
+        0x00, 0x00, 0x00, 0x0a,
+    };
+    // clang-format on
+
+    memset(test_policy_table, 0, sizeof(test_policy_table));
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_add_policy(policy, sizeof(policy));
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "aergo.system");
+
+    click_next();
+    assert_string_equal(display_title, "Function");
+    assert_string_equal(display_text, "v1stake");
+
+    click_next();
+    assert_string_equal(display_title, "Max Amount");
+    assert_string_equal(display_text, "200 AERGO");
+
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "524845C24CD3E");
+
+    click_next();
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Chain ID");
+    assert_string_equal(display_text, "C986BF7453BD");
+
+    click_next();
+    assert_string_equal(display_title, "Nonces");
+    assert_string_equal(display_text, "4090 to 4099");
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    // not stored before the approval
+    send_transaction(raw_tx, sizeof(raw_tx));
+    assert_null(matched_policy);
+
+    on_add_policy(policy, sizeof(policy));
+    on_policy_approved();
+
+    // a single confirmation
+    send_transaction(raw_tx, sizeof(raw_tx));
+    assert_non_null(matched_policy);
+    assert_string_equal(arena.txn.policy_text, "v1stake, 123.456 AERGO");
+
+    // signed: the same nonce is not accepted again
+    policy_mark_used();
+    assert_null(matched_policy);
+    assert_true(policy_lookup((unsigned char *)"aergo.system", 12, "v1stake", 7)->next_nonce == 4099);
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+    assert_null(matched_policy);
+
+    click_next();
+    assert_string_equal(display_title, "Stake");
+    assert_string_equal(display_text, "123.456 AERGO");
+
+    // the amount is above the maximum: up to 100 AERGO
+    memcpy(policy + 54, "\x05\x6b\xc7\x5e\x2d\x63\x10\x00\x00", 9);
+    on_add_policy(policy, sizeof(policy));
+    on_policy_approved();
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+    assert_null(matched_policy);
+
+    // invalid nonce window
+    policy[sizeof(policy) - 1] = 0;
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_add_policy(policy, sizeof(policy));
+      fail();
+    }
+    assert_int_equal(ret, SW_INVALID_POLICY);
+}
+
+static void test_signing_policy_other_command(void **state) {
+    (void) state;
+
+    // clang-format off
+    // aergo.system | v1stake | chain ID | up to 200 AERGO | nonces 4090 to 4099
+    uint8_t policy[] = {
+        0x0c, 'a', 'e', 'r', 'g', 'o', '.', 's', 'y', 's', 't', 'e', 'm',
+        0x07, 'v', '1', 's', 't', 'a', 'k', 'e',
+        0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5, 0x3a,
+        0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62, 0xdc,
+        0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93, 0x0b,
+        0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53, 0xbd,
+        0x09, 0x0a, 0xd7, 0x8e, 0xbc, 0x5a, 0xc6, 0x20, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xfa,
+        0x00, 0x00, 0x00, 0x0a,
+    };
+    // clang-format on
+
+    /* another recipient, with its key */
+    unsigned char path[4 + 12];
+    uint32_t key = policy_key((unsigned char *)"attacker.aer", 12, "v1stake", 7);
+    memcpy(path, &key, 4);
+    memcpy(path + 4, "attacker.aer", 12);
+
+    memset(test_policy_table, 0, sizeof(test_policy_table));
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_add_policy(policy, sizeof(policy));
+      assert_int_equal(stream_ins, INS_ADD_POLICY);
+      /* a GET_EXTENDED_KEY arrives while the policy is displayed. it ends
+         the review, then writes its path over the key and the recipient */
+      assert_true(stream_is_ended_by(INS_GET_EXTENDED_KEY));
+      reset_stream();
+      memcpy(arena.xkey.path, path, sizeof path);
+      /* the approval does not store the changed entry */
+      on_policy_approved();
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_null(policy_lookup((unsigned char *)"aergo.system", 12, "v1stake", 7));
+    assert_null(policy_lookup((unsigned char *)"attacker.aer", 12, "v1stake", 7));
+}
+
+static void test_get_screen(void **state) {
+    (void) state;
+    unsigned char out[4 + 1 + sizeof(global_title) + 1 + sizeof(global_text)];
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x01,
+        // transaction
+        0x08, 0x82, 0x20, 0x12, 0x21, 0x02, 0x9d, 0x02,
+        0x05, 0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53,
+        0x68, 0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac,
+        0x98, 0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c,
+        0x06, 0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x0c,
+        0x61, 0x65, 0x72, 0x67, 0x6f, 0x2e, 0x73, 0x79,
+        0x73, 0x74, 0x65, 0x6d, 0x22, 0x09, 0x06, 0xb1,
+        0x4b, 0xd1, 0xe6, 0xee, 0xa0, 0x00, 0x00, 0x2a,
+        0x12, 0x7b, 0x22, 0x4e, 0x61, 0x6d, 0x65, 0x22,
+        0x3a, 0x22, 0x76, 0x31, 0x73, 0x74, 0x61, 0x6b,
+        0x65, 0x22, 0x7d, 0x3a, 0x01, 0x00, 0x40, 0x01,
+        0x4a, 0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3,
+        0xe5, 0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d,
+        0x62, 0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48,
+        0x93, 0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74,
+        0x53, 0xbd,
+    };
+    // clang-format on
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+    get_screen(out);
+    assert_int_equal(out[1], 0);
+
+    // the strings of the dynamic step
+    SCREEN_STRINGS(global_title, global_text);
+
+    click_next();
+    assert_string_equal(display_title, "Stake");
+    // page 1 of 1 screen
+    assert_int_equal(get_screen(out), 4 + 1 + 5 + 1 + 13);
+    assert_memory_equal(out, "\x00\x01\x00\x01\x05" "Stake" "\x0D" "123.456 AERGO", 4 + 1 + 5 + 1 + 13);
+
+    // a static step reports its own strings and keeps the last page
+    click_next();
+    assert_string_equal(display_title, "Review");
+    SCREEN_STRINGS("Review", "Transaction");
+    assert_int_equal(get_screen(out), 4 + 1 + 6 + 1 + 11);
+    assert_memory_equal(out, "\x00\x01\x00\x01\x06" "Review" "\x0B" "Transaction", 4 + 1 + 6 + 1 + 11);
+
+    SCREEN_STRINGS("", "");
+}
+
+static void test_max_fields(void **state) {
+    (void) state;
+    int i;
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    clear_screens();
+    for (i = 0; i < MAX_FIELDS; i++) {
+      add_screens("Field", "text", 4, false);
+    }
+    assert_int_equal(num_fields, MAX_FIELDS);
+
+    ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      add_screens("Field", "text", 4, false);
+      fail();
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(num_fields, MAX_FIELDS);
+
+    clear_screens();
+}
+
+static void test_stats(void **state) {
+    (void) state;
+    unsigned char out[128];
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x01,
+        // transaction
+        0x08, 0x82, 0x20, 0x12, 0x21, 0x02, 0x9d, 0x02,
+        0x05, 0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53,
+        0x68, 0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac,
+        0x98, 0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c,
+        0x06, 0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x0c,
+        0x61, 0x65, 0x72, 0x67, 0x6f, 0x2e, 0x73, 0x79,
+        0x73, 0x74, 0x65, 0x6d, 0x22, 0x09, 0x06, 0xb1,
+        0x4b, 0xd1, 0xe6, 0xee, 0xa0, 0x00, 0x00, 0x2a,
+        0x12, 0x7b, 0x22, 0x4e, 0x61, 0x6d, 0x65, 0x22,
+        0x3a, 0x22, 0x76, 0x31, 0x73, 0x74, 0x61, 0x6b,
+        0x65, 0x22, 0x7d, 0x3a, 0x01, 0x00, 0x40, 0x01,
+        0x4a, 0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3,
+        0xe5, 0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d,
+        0x62, 0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48,
+        0x93, 0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74,
+        0x53, 0xbd,
+    };
+    // clang-format on
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    stats_reset();
+    STATS_APDU(0x04);  // sign transaction
+    STATS_APDU(0x80);
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+    assert_int_equal(stats.parts, 1);
+    assert_int_equal(stats.pages, 0);
+
+    click_next();
+    assert_string_equal(display_title, "Stake");
+    click_next();
+    click_prev();
+    assert_int_equal(stats.pages, 2);
+
+    // APDUs per INS, then parts, re-streams, hashed bytes, hash calls, pages
+    assert_int_equal(get_stats(out), 4 * STATS_MAX_INS + 4 * 6 + 8 * STATS_PHASES);
+    assert_int_equal(out[4 * 0x04 + 3], 1);
+    assert_int_equal(out[3], 1);
+    assert_int_equal(out[4 * STATS_MAX_INS + 3], 1);
+    assert_int_equal(out[4 * STATS_MAX_INS + 4 * 4 + 3], 2);
+
+    stats_reset();
+    assert_int_equal(stats.parts, 0);
+    assert_int_equal(stats.pages, 0);
+}
+
+static void test_trace(void **state) {
+    (void) state;
+    unsigned char apdu[5] = {0xAE, 0x04, 0x03, 0x00, 0x7A};
+    unsigned char reply[2] = {0x90, 0x00};
+    unsigned char out[TRACE_HEADER_SIZE + TRACE_EVENT_SIZE * TRACE_MAX_PER_READ];
+    unsigned int i;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x01,
+        // transaction
+        0x08, 0x82, 0x20, 0x12, 0x21, 0x02, 0x9d, 0x02,
+        0x05, 0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53,
+        0x68, 0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac,
+        0x98, 0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c,
+        0x06, 0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x0c,
+        0x61, 0x65, 0x72, 0x67, 0x6f, 0x2e, 0x73, 0x79,
+        0x73, 0x74, 0x65, 0x6d, 0x22, 0x09, 0x06, 0xb1,
+        0x4b, 0xd1, 0xe6, 0xee, 0xa0, 0x00, 0x00, 0x2a,
+        0x12, 0x7b, 0x22, 0x4e, 0x61, 0x6d, 0x65, 0x22,
+        0x3a, 0x22, 0x76, 0x31, 0x73, 0x74, 0x61, 0x6b,
+        0x65, 0x22, 0x7d, 0x3a, 0x01, 0x00, 0x40, 0x01,
+        0x4a, 0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3,
+        0xe5, 0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d,
+        0x62, 0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48,
+        0x93, 0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74,
+        0x53, 0xbd,
+    };
+    // clang-format on
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    trace_reset();
+    trace_ticks = 7;
+
+    trace_apdu_in(apdu, false);
+    send_transaction(raw_tx, sizeof(raw_tx));
+    click_next();
+    trace_apdu_out(reply, 2);
+
+    // header
+    assert_int_equal(get_trace(out, 0), TRACE_HEADER_SIZE + 4 * TRACE_EVENT_SIZE);
+    assert_int_equal(out[0], TRACE_CLOCK_TICKS);
+    assert_int_equal(out[1], 4);
+    assert_int_equal(out[3], 4);
+    assert_int_equal(out[7], 4);
+
+    // APDU in: INS, P1 and Lc
+    assert_memory_equal(out + 8, "\x00\x00\x00\x07\x01\x04\x03\x7A", 8);
+    // a single part
+    assert_int_equal(out[16 + 4], TRACE_EV_PART);
+    assert_int_equal(out[16 + 5], TRACE_FIRST | TRACE_LAST | TRACE_COMPLETE);
+    assert_int_equal(out[16 + 7], sizeof(raw_tx));
+    // from the review screen to the first page
+    assert_int_equal(out[24 + 4], TRACE_EV_PAGE);
+    assert_int_equal(out[24 + 5], PAGE_FIRST);
+    assert_int_equal(out[24 + 7], 1);
+    // APDU out
+    assert_memory_equal(out + 32 + 4, "\x02\x00\x90\x00", 4);
+
+    // from an event
+    assert_int_equal(get_trace(out, 3), TRACE_HEADER_SIZE + TRACE_EVENT_SIZE);
+    assert_int_equal(out[1], 1);
+    assert_int_equal(out[8 + 4], TRACE_EV_APDU_OUT);
+    assert_int_equal(get_trace(out, 4), TRACE_HEADER_SIZE);
+    assert_int_equal(get_trace(out, 5), TRACE_HEADER_SIZE);
+
+    // the reads of the trace are not recorded
+    apdu[1] = 0x0F;
+    trace_apdu_in(apdu, true);
+    trace_apdu_out(reply, 2);
+    get_trace(out, 0);
+    assert_int_equal(out[1], 4);
+
+    // the oldest events are overwritten
+    apdu[1] = 0x01;
+    for (i = 0; i < TRACE_SIZE; i++) {
+      trace_apdu_in(apdu, false);
+    }
+    get_trace(out, 0);
+    assert_int_equal(out[1], TRACE_MAX_PER_READ);
+    assert_int_equal((out[2] << 8) | out[3], TRACE_SIZE);
+    assert_int_equal(out[7], TRACE_SIZE + 4);
+    assert_int_equal(out[8 + 5], 0x01);
+
+    trace_reset();
+    get_trace(out, 0);
+    assert_int_equal(out[1], 0);
+    assert_int_equal(out[7], 0);
+}
+
+static void test_stack_usage(void **state) {
+    (void) state;
+    unsigned char out[4 + 2 * STACK_MAX_INS + 2 * STACK_TXN_TYPES];
+
+    stack_reset();
+    assert_int_equal(stack_high_water(), 0);
+
+    // get public key
+    stack_command_start(0x02, false, TXN_NORMAL);
+    sim_stack[40] = 0;
+    assert_int_equal(stack_high_water(), 24 * 4);
+
+    // sign a contract call, stored when the next command arrives
+    stack_command_start(0x04, true, TXN_NORMAL);
+    assert_int_equal(stack_high_water(), 0);
+    sim_stack[50] = 0;
+    sim_stack[10] = 0;
+
+    stack_command_start(0x02, false, TXN_CALL);
+    sim_stack[60] = 0;
+    stack_command_start(0x80, false, TXN_CALL);
+
+    assert_int_equal(get_stack_usage(out), sizeof(out));
+    // stack size and peak
+    assert_memory_equal(out, "\x01\x00\x00\xD8", 4);
+    // per INS: the higher of the get public key commands
+    assert_int_equal((out[4 + 2 * 0x02] << 8) | out[5 + 2 * 0x02], 24 * 4);
+    assert_int_equal((out[4 + 2 * 0x04] << 8) | out[5 + 2 * 0x04], 54 * 4);
+    // per transaction type
+    assert_int_equal((out[4 + 2 * STACK_MAX_INS + 2 * TXN_CALL] << 8) |
+                     out[5 + 2 * STACK_MAX_INS + 2 * TXN_CALL], 54 * 4);
+    assert_int_equal(out[4 + 2 * STACK_MAX_INS + 2 * TXN_NORMAL + 1], 0);
+
+    // other INS values use the slot 0
+    sim_stack[30] = 0;
+    stack_command_start(0x01, false, TXN_CALL);
+    assert_int_equal(stack_usage.per_ins[0], 34 * 4);
+
+    stack_reset();
+    assert_int_equal(stack_usage.peak, 0);
+    assert_int_equal(stack_high_water(), 0);
+}
+
+static void test_tx_display_transfer_labeled(void **state) {
+    (void) state;
+
+    unsigned char contact[33 + 1 + 12];
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x04,
+        // transaction
+        0x08, 0x0a, 0x12, 0x21, 0x02, 0x9d, 0x02, 0x05,
+        0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53, 0x68,
+        0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac, 0x98,
+        0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c, 0x06,
+        0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21, 0x03,
+        0x8c, 0xb9, 0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69,
+        0x09, 0x3c, 0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9,
+        0xfa, 0x50, 0x17, 0x30, 0x42, 0x23, 0xf9, 0xad,
+        0x1a, 0x8c, 0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb,
+        0x22, 0x08, 0x14, 0xd1, 0x12, 0x0d, 0x7b, 0x16,
+        0x00, 0x00, 0x3a, 0x01, 0x00, 0x40, 0x04, 0x4a,
+        0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5,
+        0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62,
+        0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93,
+        0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53,
+        0xbd,
+    };
+
+    memcpy(contact, abi_send, 33);
+    contact[33] = 12;
+    memcpy(contact + 34, "Exchange-Hot", 12);
+
+    memset(test_address_book, 0, sizeof(test_address_book));
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_add_address(contact, sizeof(contact));
+    address_store(&arena.contact.entry);
+
+    send_transaction(raw_tx, sizeof(raw_tx));
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    assert_string_equal(display_title, "Amount");
+    assert_string_equal(display_text, "1.5 AERGO");
+
+    click_next();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "Exchange-Hot ");
+
+    click_next();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "(verified)");
+
+    click_next();
+    assert_string_equal(display_title, "Address");
+    assert_string_equal(display_text, "AmPWwmdgpvPRP");
+
+    click_next();
+    click_next();
+    click_next();
+    assert_string_equal(display_title, "Address");
+    assert_string_equal(display_text, "d64mzKJ9RCAhp");
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    // BACKWARDS
+
+    click_prev();
+    assert_string_equal(display_title, "Address");
+    assert_string_equal(display_text, "d64mzKJ9RCAhp");
+
+    click_prev();
+    click_prev();
+    click_prev();
+    click_prev();
+    assert_string_equal(display_title, "Recipient");
+    assert_string_equal(display_text, "(verified)");
+
+    address_book_clear();
+}
+
+// Message ADDRESS
+static void test_display_account(void **state) {
+    (void) state;
+
+    // clang-format off
+    uint8_t public_key_bytes[] = {
+        0x01, 0x02,
+        0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
         0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12,
         0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a,
         0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20
@@ -5183,12 +6867,83 @@ loc_exit:
     puts("exiting...");
 }
 
+static void test_display_extended_key(void **state) {
+    (void) state;
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    arena.xkey.path[0] = 0x8000002C;
+    arena.xkey.path[1] = 0x800001B9;
+    arena.xkey.path[2] = 0x80000000;
+    arena.xkey.path[3] = 0;
+    arena.xkey.path[4] = 1234;
+    arena.xkey.path_len = 5;
+
+    on_export_extended_key();
+    assert_int_equal(stream_ins, INS_GET_EXTENDED_KEY);
+
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    click_next();
+    assert_string_equal(display_title, "Path");
+    assert_string_equal(display_text, "44'/441'/0'/0");
+
+    click_next();
+    assert_string_equal(display_title, "Path");
+    assert_string_equal(display_text, "/1234");
+
+    click_next();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+
+    // BACKWARDS
+
+    click_prev();
+    assert_string_equal(display_title, "Path");
+    assert_string_equal(display_text, "/1234");
+
+    click_prev();
+    assert_string_equal(display_title, "Path");
+    assert_string_equal(display_text, "44'/441'/0'/0");
+
+    click_prev();
+    assert_string_equal(display_title, "Review");
+    assert_string_equal(display_text, "Transaction");
+}
+
+static void test_extended_key_other_command(void **state) {
+    (void) state;
+
+    arena.xkey.path[0] = 0x8000002C;
+    arena.xkey.path[1] = 0x800001B9;
+    arena.xkey.path[2] = 0x80000000;
+    arena.xkey.path_len = 3;
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      on_export_extended_key();
+      /* a GET_PUBLIC_KEYS arrives while the path is displayed. it ends the
+         review, then writes its own path */
+      assert_true(stream_is_ended_by(INS_GET_PUBLIC_KEYS));
+      reset_stream();
+      arena.keys.path[2] = 0x80000001;
+      /* the approval does not export the key of the changed path */
+      stream_approve(INS_GET_EXTENDED_KEY);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_tx_display_normal),
       cmocka_unit_test(test_tx_display_normal_long_payload),
+      cmocka_unit_test(test_tx_display_envelope),
       cmocka_unit_test(test_tx_display_transfer_1),
       cmocka_unit_test(test_tx_display_transfer_2),
+      cmocka_unit_test(test_tx_display_batch),
+      cmocka_unit_test(test_tx_display_batch_during_review),
       cmocka_unit_test(test_tx_display_call_1),
       cmocka_unit_test(test_tx_display_call_2),
       cmocka_unit_test(test_tx_display_call_big),
@@ -5214,9 +6969,33 @@ int main() {
       cmocka_unit_test(test_tx_display_governance_enable_config),
       cmocka_unit_test(test_tx_display_governance_change_cluster),
       // message
+      cmocka_unit_test(test_tx_display_settings),
+      cmocka_unit_test(test_abi_register),
+      cmocka_unit_test(test_abi_register_other_command),
+      cmocka_unit_test(test_abi_registry_full),
+      cmocka_unit_test(test_tx_display_call_abi),
+      cmocka_unit_test(test_address_book_add),
+      cmocka_unit_test(test_address_book_other_command),
+      cmocka_unit_test(test_address_book_full),
+      cmocka_unit_test(test_tx_display_transfer_labeled),
+      cmocka_unit_test(test_signing_policy),
+      cmocka_unit_test(test_signing_policy_other_command),
+      cmocka_unit_test(test_get_screen),
+      cmocka_unit_test(test_max_fields),
+      cmocka_unit_test(test_stats),
+      cmocka_unit_test(test_trace),
+      cmocka_unit_test(test_stack_usage),
       cmocka_unit_test(test_display_message),
+      cmocka_unit_test(test_message_part_flags),
+      cmocka_unit_test(test_display_long_message),
+      cmocka_unit_test(test_stream_owner),
+      cmocka_unit_test(test_stream_message_format),
+      cmocka_unit_test(test_stream_reset),
+      cmocka_unit_test(test_stream_approve),
       // account address
       cmocka_unit_test(test_display_account),
+      cmocka_unit_test(test_display_extended_key),
+      cmocka_unit_test(test_extended_key_other_command),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -11,7 +11,10 @@
 
 #include "testing.h"
 #include "../src/globals.h"
+#include "../src/apdu.h"
 #include "../src/transaction.h"
+#include "../src/stream.h"
+#include "../src/dry_run.h"
 
 static const char hexdigits[] = {
   '0', '1', '2', '3', '4', '5', '6', '7',
@@ -101,8 +104,8 @@ static void test_tx_parsing_normal(void **state) {
     assert_int_equal(txn.type, 0);
     assert_int_equal(txn.nonce, 1);
     assert_string_equal(account_address, "AmP4AYWHKrxnPqvoUATyJhMwarzJAphWdkosz24AWgiD2sQ18si9");
-    assert_string_equal(recipient_address, "AmMDEyc36FNXB3Fq1a61HeVJRT4yssMEP11NWWE9Qx8yhfRKexvq");
-    assert_string_equal(amount_str, "123.456 AERGO");
+    assert_string_equal(arena.txn.recipient_address, "AmMDEyc36FNXB3Fq1a61HeVJRT4yssMEP11NWWE9Qx8yhfRKexvq");
+    assert_string_equal(arena.txn.amount_str, "123.456 AERGO");
     assert_int_equal(txn.payload_len, 32);
     assert_string_equal(payload, "0102030405060708090A0B0C0D0E0FFF");
     assert_string_equal(txn.gasPrice, "");
@@ -158,8 +161,8 @@ static void test_tx_parsing_transfer(void **state) {
     assert_int_equal(txn.type, 4);
     assert_int_equal(txn.nonce, 10);
     assert_string_equal(account_address, "AmMhNZVhirdVrgL11koUh1j6TPnH118KqxdihFD9YXHD63VpyFGu");
-    assert_string_equal(recipient_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
-    assert_string_equal(amount_str, "1.5 AERGO");
+    assert_string_equal(arena.txn.recipient_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
+    assert_string_equal(arena.txn.amount_str, "1.5 AERGO");
     assert_int_equal(txn.payload_len, 0);
     assert_null(payload);
     assert_string_equal(txn.gasPrice, "");
@@ -218,8 +221,8 @@ static void test_tx_parsing_call_1(void **state) {
     assert_int_equal(txn.type, 5);
     assert_int_equal(txn.nonce, 25);
     assert_string_equal(account_address, "AmMhNZVhirdVrgL11koUh1j6TPnH118KqxdihFD9YXHD63VpyFGu");
-    assert_string_equal(recipient_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
-    assert_string_equal(amount_str, "0 AERGO");
+    assert_string_equal(arena.txn.recipient_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
+    assert_string_equal(arena.txn.amount_str, "0 AERGO");
     assert_int_equal(txn.payload_len, 0x21);
     assert_string_equal(payload, "{\"Name\":\"hello\",\"Args\":[\"world\"]}");
     assert_string_equal(txn.gasPrice, "");
@@ -275,8 +278,8 @@ static void test_tx_parsing_call_2(void **state) {
     assert_int_equal(txn.type, 5);
     assert_int_equal(txn.nonce, 512);
     assert_string_equal(account_address, "AmMhNZVhirdVrgL11koUh1j6TPnH118KqxdihFD9YXHD63VpyFGu");
-    assert_string_equal(recipient_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
-    assert_string_equal(amount_str, "0.123456789012345678 AERGO");
+    assert_string_equal(arena.txn.recipient_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
+    assert_string_equal(arena.txn.amount_str, "0.123456789012345678 AERGO");
     assert_int_equal(txn.payload_len, 0);
     assert_null(payload);
     assert_string_equal(txn.gasPrice, "");
@@ -336,8 +339,8 @@ static void test_tx_parsing_multicall(void **state) {
     assert_int_equal(txn.type, 7);
     assert_int_equal(txn.nonce, 250);
     assert_string_equal(account_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
-    assert_string_equal(recipient_address, "");
-    assert_string_equal(amount_str, "0 AERGO");
+    assert_string_equal(arena.txn.recipient_address, "");
+    assert_string_equal(arena.txn.amount_str, "0 AERGO");
     assert_int_equal(txn.payload_len, 0x4e);
     assert_string_equal(payload, "[[\"let\",\"obj\",{\"one\":1,\"two\":2}],[\"set\",\"%obj%\",\"three\",3],[\"return\",\"%obj%\"]]");
     assert_string_equal(txn.gasPrice, "");
@@ -396,8 +399,8 @@ static void test_tx_parsing_deploy(void **state) {
     assert_int_equal(txn.type, 6);
     assert_int_equal(txn.nonce, 1025);
     assert_string_equal(account_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
-    assert_string_equal(recipient_address, "");
-    assert_string_equal(amount_str, "0 AERGO");
+    assert_string_equal(arena.txn.recipient_address, "");
+    assert_string_equal(arena.txn.amount_str, "0 AERGO");
     assert_int_equal(txn.payload_len, 0x40);
     assert_string_equal(payload, "0102030405060708090A0B0C0D0E0FFF0102030405060708090A0B0C0D0E0FFF");
     assert_string_equal(txn.gasPrice, "");
@@ -461,8 +464,8 @@ static void test_tx_parsing_governance(void **state) {
     assert_int_equal(txn.type, 1);
     assert_int_equal(txn.nonce, 2050);
     assert_string_equal(account_address, "AmPWwmdgpvPRPtykgCCWvVdZS6h7b6w9UzcLcsEd64mzKJ9RCAhp");
-    assert_string_equal(recipient_address, "aergo.enterprise");
-    assert_string_equal(amount_str, "0 AERGO");
+    assert_string_equal(arena.txn.recipient_address, "aergo.enterprise");
+    assert_string_equal(arena.txn.amount_str, "0 AERGO");
     assert_int_equal(txn.payload_len, 0x56);
     assert_string_equal(payload, "{\"Name\":\"appendAdmin\",\"Args\":[\"AmMDEyc36FNXB3Fq1a61HeVJRT4yssMEP11NWWE9Qx8yhfRKexvq\"]}");
     assert_string_equal(txn.gasPrice, "");
@@ -661,6 +664,278 @@ static void test_tx_parsing_incomplete_txn(void **state) {
 }
 
 
+// DEPLOY - with the payload hash instead of the payload
+static void test_tx_parsing_prehashed_deploy(void **state) {
+    (void) state;
+    unsigned char hash[32];
+    char hex[65];
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x06,
+        // transaction
+        0x08, 0x81, 0x08, 0x12, 0x21, 0x03, 0x8c, 0xb9,
+        0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69, 0x09, 0x3c,
+        0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9, 0xfa, 0x50,
+        0x17, 0x30, 0x42, 0x23, 0xf9, 0xad, 0x1a, 0x8c,
+        0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb, 0x22, 0x01,
+        0x00, 0x2a, 0x20, 0x01, 0x02, 0x03, 0x04, 0x05,
+        0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+        0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15,
+        0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+        0x1e, 0x1f, 0x20, 0x3a, 0x01, 0x00, 0x40, 0x06,
+        0x4a, 0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3,
+        0xe5, 0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d,
+        0x62, 0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48,
+        0x93, 0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74,
+        0x53, 0xbd,
+    };
+
+    // the transaction hash uses the payload hash in place of the payload
+    payload_is_prehashed = false;
+    assert_int_equal(parse_transaction(raw_tx, sizeof(raw_tx)), 0);
+    memcpy(hash, txn_hash, 32);
+
+    payload_is_prehashed = true;
+    assert_int_equal(parse_transaction(raw_tx, sizeof(raw_tx)), 0);
+    payload_is_prehashed = false;
+
+    assert_true(txn_is_complete);
+    assert_memory_equal(txn_hash, hash, 32);
+    assert_null(txn.payload);
+    to_hex(arena.txn.payload_hash, 32, hex);
+    assert_string_equal(hex, "0102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F20");
+
+    // only for contract deployments
+    raw_tx[0] = 0x04;
+    raw_tx[sizeof(raw_tx) - 35] = 0x04;
+    payload_is_prehashed = true;
+    assert_int_equal(parse_transaction(raw_tx, sizeof(raw_tx)), 0x6725);
+    payload_is_prehashed = false;
+}
+
+// DRY RUN - the parts are received on the same buffer
+static void test_tx_dry_run(void **state) {
+    (void) state;
+    unsigned char apdu[256];
+    unsigned char out[256];
+    char hex[65];
+    unsigned int len;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x04,
+        // transaction
+        0x08, 0x0a, 0x12, 0x21, 0x02, 0x9d, 0x02, 0x05,
+        0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53, 0x68,
+        0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac, 0x98,
+        0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c, 0x06,
+        0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21, 0x03,
+        0x8c, 0xb9, 0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69,
+        0x09, 0x3c, 0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9,
+        0xfa, 0x50, 0x17, 0x30, 0x42, 0x23, 0xf9, 0xad,
+        0x1a, 0x8c, 0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb,
+        0x22, 0x08, 0x14, 0xd1, 0x12, 0x0d, 0x7b, 0x16,
+        0x00, 0x00, 0x3a, 0x01, 0x00, 0x40, 0x04, 0x4a,
+        0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3, 0xe5,
+        0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d, 0x62,
+        0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48, 0x93,
+        0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74, 0x53,
+        0xbd,
+    };
+
+    // the sha256 of an empty payload
+    const char *empty_hash = "E3B0C44298FC1C149AFBF4C8996FB92427AE41E4649B934CA495991B7852B855";
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    memcpy(apdu, raw_tx, 90);
+    on_dry_run_part(apdu, 90, true, false);
+    assert_false(txn_is_complete);
+
+    memset(apdu, 0xEE, sizeof apdu);
+    memcpy(apdu, raw_tx + 90, sizeof(raw_tx) - 90);
+    on_dry_run_part(apdu, sizeof(raw_tx) - 90, false, true);
+    assert_true(txn_is_complete);
+    memset(apdu, 0xEE, sizeof apdu);
+
+    len = get_dry_run_result(out);
+    assert_int_equal(len, 64 + 3 + 10 + 35 + 10 + 10 + 3 + 34);
+
+    assert_memory_equal(out, txn_hash, 32);
+    to_hex(out + 32, 32, hex);
+    assert_string_equal(hex, empty_hash);
+
+    unsigned char *tlv = out + 64;
+    // type
+    assert_int_equal(tlv[0], DRY_TYPE);
+    assert_int_equal(tlv[1], 1);
+    assert_int_equal(tlv[2], 4);
+    tlv += 3;
+    // nonce
+    assert_int_equal(tlv[0], DRY_NONCE);
+    assert_int_equal(tlv[1], 8);
+    assert_memory_equal(tlv + 2, "\0\0\0\0\0\0\0\x0a", 8);
+    tlv += 10;
+    // recipient
+    assert_int_equal(tlv[0], DRY_RECIPIENT);
+    assert_int_equal(tlv[1], 33);
+    assert_memory_equal(tlv + 2, raw_tx + 40, 33);
+    tlv += 35;
+    // amount
+    assert_int_equal(tlv[0], DRY_AMOUNT);
+    assert_int_equal(tlv[1], 8);
+    assert_memory_equal(tlv + 2, "\x14\xd1\x12\x0d\x7b\x16\0\0", 8);
+    tlv += 10;
+    // gas limit
+    assert_int_equal(tlv[0], DRY_GAS_LIMIT);
+    assert_int_equal(tlv[1], 8);
+    assert_memory_equal(tlv + 2, "\0\0\0\0\0\0\0\0", 8);
+    tlv += 10;
+    // gas price
+    assert_int_equal(tlv[0], DRY_GAS_PRICE);
+    assert_int_equal(tlv[1], 1);
+    assert_int_equal(tlv[2], 0);
+    tlv += 3;
+    // chain id
+    assert_int_equal(tlv[0], DRY_CHAIN_ID);
+    assert_int_equal(tlv[1], 32);
+    to_hex(tlv + 2, 32, hex);
+    assert_string_equal(hex, "524845C24CD3E53AECBCDA8E315D62DC95A7F2F82548930BC2FCC986BF7453BD");
+}
+
+// DRY RUN WITH THE LAST FIELDS SPLIT BETWEEN PARTS
+static void test_tx_dry_run_split_fields(void **state) {
+    (void) state;
+    unsigned char apdu[256];
+    unsigned char out[256];
+    unsigned int len, pos;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x04,
+        // transaction
+        0x08, 0x0a, 0x12, 0x21, 0x02, 0x9d, 0x02, 0x05,
+        0x91, 0xe7, 0xfb, 0x7b, 0x09, 0x21, 0x53, 0x68,
+        0x19, 0x95, 0xf8, 0x06, 0x09, 0xf0, 0xac, 0x98,
+        0x8a, 0x4d, 0x93, 0x5e, 0x0e, 0xa6, 0x3c, 0x06,
+        0x0f, 0x19, 0x54, 0xb0, 0x5f, 0x1a, 0x21, 0x03,
+        0x8c, 0xb9, 0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69,
+        0x09, 0x3c, 0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9,
+        0xfa, 0x50, 0x17, 0x30, 0x42, 0x23, 0xf9, 0xad,
+        0x1a, 0x8c, 0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb,
+        0x22, 0x08, 0x14, 0xd1, 0x12, 0x0d, 0x7b, 0x16,
+        0x00, 0x00, 0x3a, 0x03, 0x01, 0x02, 0x03, 0x40,
+        0x04, 0x4a, 0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c,
+        0xd3, 0xe5, 0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31,
+        0x5d, 0x62, 0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25,
+        0x48, 0x93, 0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf,
+        0x74, 0x53, 0xbd,
+    };
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    // the first part ends on the tag of the gas price
+    memcpy(apdu, raw_tx, 84);
+    on_dry_run_part(apdu, 84, true, false);
+    assert_false(txn_is_complete);
+
+    // the gas price is on the buffer of the last fields, that is
+    // overwritten with the incomplete chain id
+    memset(apdu, 0xEE, sizeof apdu);
+    memcpy(apdu, raw_tx + 84, 20);
+    on_dry_run_part(apdu, 20, false, false);
+    assert_false(txn_is_complete);
+
+    memset(apdu, 0xEE, sizeof apdu);
+    memcpy(apdu, raw_tx + 104, sizeof(raw_tx) - 104);
+    on_dry_run_part(apdu, sizeof(raw_tx) - 104, false, true);
+    assert_true(txn_is_complete);
+
+    len = get_dry_run_result(out);
+
+    for (pos = 64; pos < len; pos += 2 + out[pos + 1]) {
+      if (out[pos] == DRY_GAS_PRICE) break;
+    }
+    assert_true(pos < len);
+    assert_int_equal(out[pos + 1], 3);
+    assert_memory_equal(out + pos + 2, "\x01\x02\x03", 3);
+}
+
+// DRY RUN OF A DEPLOY, WITHOUT RECIPIENT
+static void test_tx_dry_run_deploy(void **state) {
+    (void) state;
+    unsigned char out[256];
+    unsigned int len, pos;
+
+    // clang-format off
+    uint8_t raw_tx[] = {
+        // tx type
+        0x06,
+        // transaction
+        0x08, 0x81, 0x08, 0x12, 0x21, 0x03, 0x8c, 0xb9,
+        0x2c, 0xde, 0xbf, 0x39, 0x98, 0x69, 0x09, 0x3c,
+        0xac, 0x47, 0xe3, 0x70, 0xd8, 0xa9, 0xfa, 0x50,
+        0x17, 0x30, 0x42, 0x23, 0xf9, 0xad, 0x1a, 0x8c,
+        0x0a, 0x05, 0xa9, 0x06, 0xa9, 0xcb, 0x22, 0x01,
+        0x00, 0x2a, 0x40, 0x30, 0x31, 0x30, 0x32, 0x30,
+        0x33, 0x30, 0x34, 0x30, 0x35, 0x30, 0x36, 0x30,
+        0x37, 0x30, 0x38, 0x30, 0x39, 0x30, 0x41, 0x30,
+        0x42, 0x30, 0x43, 0x30, 0x44, 0x30, 0x45, 0x30,
+        0x46, 0x46, 0x46, 0x30, 0x31, 0x30, 0x32, 0x30,
+        0x33, 0x30, 0x34, 0x30, 0x35, 0x30, 0x36, 0x30,
+        0x37, 0x30, 0x38, 0x30, 0x39, 0x30, 0x41, 0x30,
+        0x42, 0x30, 0x43, 0x30, 0x44, 0x30, 0x45, 0x30,
+        0x46, 0x46, 0x46, 0x3a, 0x01, 0x00, 0x40, 0x06,
+        0x4a, 0x20, 0x52, 0x48, 0x45, 0xc2, 0x4c, 0xd3,
+        0xe5, 0x3a, 0xec, 0xbc, 0xda, 0x8e, 0x31, 0x5d,
+        0x62, 0xdc, 0x95, 0xa7, 0xf2, 0xf8, 0x25, 0x48,
+        0x93, 0x0b, 0xc2, 0xfc, 0xc9, 0x86, 0xbf, 0x74,
+        0x53, 0xbd,
+    };
+
+    int ret = setjmp(jump_buffer);
+    assert_int_equal(ret, 0);
+
+    on_dry_run_part(raw_tx, sizeof(raw_tx), true, true);
+    assert_true(txn_is_complete);
+
+    len = get_dry_run_result(out);
+
+    /* no recipient field */
+    for (pos = 64; pos < len; pos += 2 + out[pos + 1]) {
+      assert_int_not_equal(out[pos], DRY_RECIPIENT);
+    }
+    assert_int_equal(pos, len);
+}
+
+// DRY RUN DURING ANOTHER STREAM
+static void test_tx_dry_run_other_stream(void **state) {
+    (void) state;
+    unsigned char part[60];
+    unsigned char hash[32];
+
+    memset(part, 0, sizeof part);
+    memcpy(hash, txn_hash, 32);
+
+    /* the parts of a transaction being signed */
+    stream_ins = INS_SIGN_TXN;
+
+    int ret = setjmp(jump_buffer);
+    if (ret == 0) {
+      /* a dry run part cannot continue them */
+      on_dry_run_part(part, sizeof part, false, true);
+    }
+    assert_int_equal(ret, SW_INVALID_STATE);
+    assert_int_equal(stream_ins, INS_SIGN_TXN);
+    assert_memory_equal(txn_hash, hash, 32);
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_tx_parsing_normal),
@@ -676,6 +951,11 @@ int main() {
       cmocka_unit_test(test_tx_parsing_without_account),
       cmocka_unit_test(test_tx_parsing_without_chain_id),
       cmocka_unit_test(test_tx_parsing_incomplete_txn),
+      cmocka_unit_test(test_tx_parsing_prehashed_deploy),
+      cmocka_unit_test(test_tx_dry_run),
+      cmocka_unit_test(test_tx_dry_run_split_fields),
+      cmocka_unit_test(test_tx_dry_run_deploy),
+      cmocka_unit_test(test_tx_dry_run_other_stream),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);